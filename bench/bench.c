@@ -0,0 +1,455 @@
+/*
+ * bench.c
+ *
+ * Created: 10/16/2026 2:14:52 PM
+ *  Author: Alex Ionita
+ *
+ * Benchmark firmware for the kernel hot paths, meant to run headless under
+ * simavr. TIMER1 runs at the CPU clock, so every figure is in CPU cycles.
+ * Results go out on USART0 as CSV lines:
+ *
+ *   bench,<name>,<tasks>,<samples>,<min>,<avg>,<max>
+ *
+ * Build and run, from this directory:
+ *
+ *   avr-gcc -mmcu=atmega328p -Os -I.. -DBENCH_TASKS=4 -DTASK_ARENA_SIZE=1536 \
+ *     -DTASK_STACK_DEFAULT=112 -DTASK_NOTIFY=1 -o bench.elf \
+ *     bench.c ../task.c ../mutex.c ../semaphore.c ../port_avr.c
+ *   simavr -m atmega328p -f 16000000 bench.elf 2>&1 | grep bench,
+ *
+ * The firmware halts with interrupts disabled once done, which ends simavr.
+ * The max column includes the occasional tick landing inside a sample, min
+ * is the cost of the path alone.
+ *
+ * The *_notify figures repeat the semaphore ones with task notifications,
+ * which need no object: a Semaphore is 6 bytes, notifications add 3 to
+ * each TCB.
+ */
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+
+#include "task.h"
+#include "mutex.h"
+#include "semaphore.h"
+
+// Workers taking part in the yield and tick benchmarks.
+#ifndef BENCH_TASKS
+#define BENCH_TASKS 4
+#endif
+
+// Samples taken per benchmark.
+#ifndef BENCH_ROUNDS
+#define BENCH_ROUNDS 64
+#endif
+
+// Spin loop gaps longer than this many cycles were taken by an interrupt.
+#define BENCH_GAP 64
+
+// Lead time when arming the TIMER1 compare, enough to block in between.
+#define BENCH_ARM 2000
+
+#define BENCH_YIELD 0
+#define BENCH_TICK 1
+#define BENCH_MUTEX 2
+#define BENCH_MUTEX_HANDOFF 3
+#define BENCH_ISR_IDLE 4
+#define BENCH_ISR_PREEMPT 5
+#define BENCH_SIGNAL 6
+#define BENCH_SIGNAL_NOTIFY 7
+#define BENCH_ISR_NOTIFY 8
+
+typedef struct {
+	uint16_t min;
+	uint16_t max;
+	uint32_t sum;
+	uint16_t count;
+} BenchStats;
+
+static volatile uint8_t benchPhase;
+
+static BenchStats benchStats;
+
+// TCNT1 at the start of the interval being measured.
+static volatile uint16_t benchStamp;
+
+// Set while the spinning worker should keep going.
+static volatile uint8_t benchSpin;
+
+// Workers (priority 1) and the high priority task (priority 2) wait for a
+// unit here, the controller (priority 0) collects one per finished task.
+static Semaphore benchGo;
+static Semaphore benchGoHigh;
+static Semaphore benchDone;
+
+// Given by the high priority task, and by the TIMER1 ISR.
+static Semaphore benchSignal;
+
+static Semaphore benchStop;
+
+static Mutex benchMutex;
+
+// The high priority task, target of the notifications.
+static Task *benchHigh;
+
+static void benchPutc(char c) {
+	while (!(UCSR0A & _BV(UDRE0))) {
+	}
+
+	UDR0 = c;
+}
+
+static void benchPuts(const char *s) {
+	while (*s) {
+		benchPutc(*s++);
+	}
+}
+
+static void benchPutu(uint32_t v) {
+	char buf[10];
+	uint8_t i = 0;
+
+	do {
+		buf[i++] = '0' + v % 10;
+		v /= 10;
+	} while (v);
+
+	while (i) {
+		benchPutc(buf[--i]);
+	}
+}
+
+static void benchReset(void) {
+	benchStats.min = 0xFFFF;
+	benchStats.max = 0;
+	benchStats.sum = 0;
+	benchStats.count = 0;
+}
+
+static void benchSample(uint16_t cycles) {
+	if (benchStats.count == BENCH_ROUNDS) {
+		return;
+	}
+
+	if (cycles < benchStats.min) {
+		benchStats.min = cycles;
+	}
+
+	if (cycles > benchStats.max) {
+		benchStats.max = cycles;
+	}
+
+	benchStats.sum += cycles;
+	benchStats.count++;
+}
+
+static void benchReport(const char *name, uint8_t tasks) {
+	benchPuts("bench,");
+	benchPuts(name);
+	benchPutc(',');
+	benchPutu(tasks);
+	benchPutc(',');
+	benchPutu(benchStats.count);
+	benchPutc(',');
+	benchPutu(benchStats.count ? benchStats.min : 0);
+	benchPutc(',');
+	benchPutu(benchStats.count ? benchStats.sum / benchStats.count : 0);
+	benchPutc(',');
+	benchPutu(benchStats.max);
+	benchPuts("\r\n");
+}
+
+// Fire TIMER1_COMPB BENCH_ARM cycles from now.
+static void benchArm(void) {
+	OCR1B = TCNT1 + BENCH_ARM;
+	TIFR1 = _BV(OCF1B);
+	TIMSK1 |= _BV(OCIE1B);
+}
+
+TASK_ISR(TIMER1_COMPB_vect) {
+	TIMSK1 &= ~_BV(OCIE1B);
+
+	#if TASK_NOTIFY
+	if (benchPhase == BENCH_ISR_NOTIFY) {
+		taskNotifyFromISR(benchHigh, 0, TASK_NOTIFY_INCREMENT);
+		taskPreempt();
+		return;
+	}
+	#endif
+
+	semaphoreGiveFromISR(&benchSignal);
+	taskPreempt();
+}
+
+// Wait for benchSignal, or for a notification in the *_NOTIFY phases.
+static void benchWait(void) {
+	#if TASK_NOTIFY
+	if (benchPhase == BENCH_SIGNAL_NOTIFY || benchPhase == BENCH_ISR_NOTIFY) {
+		taskNotifyWait();
+		return;
+	}
+	#endif
+
+	semaphoreTake(&benchSignal);
+}
+
+// Time from one worker calling taskYield() to the next one returning from
+// it: save, scheduler, restore.
+static void benchYield(void) {
+	uint8_t i;
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		uint16_t now = TCNT1;
+
+		// The first worker to run has no predecessor to measure from.
+		if (benchStamp) {
+			benchSample(now - benchStamp);
+		}
+
+		benchStamp = TCNT1;
+		taskYield();
+	}
+}
+
+// Cycles the tick takes away from a busy task while the others sleep.
+static void benchTick(void) {
+	uint16_t prev;
+	uint16_t now;
+	uint8_t i;
+
+	// Let the other workers reach their timed waits first.
+	for (i = 1; i < BENCH_TASKS; i++) {
+		taskYield();
+	}
+
+	prev = TCNT1;
+
+	while (benchStats.count < BENCH_ROUNDS) {
+		now = TCNT1;
+
+		if ((uint16_t)(now - prev) > BENCH_GAP) {
+			benchSample(now - prev);
+		}
+
+		prev = now;
+	}
+
+	for (i = 1; i < BENCH_TASKS; i++) {
+		semaphoreGive(&benchStop);
+	}
+}
+
+static void benchTask(void *data) {
+	uint8_t high = data != 0;
+	uint8_t i;
+
+	for (;;) {
+		semaphoreTake(high ? &benchGoHigh : &benchGo);
+
+		switch (benchPhase) {
+		case BENCH_YIELD:
+			benchYield();
+			break;
+
+		case BENCH_TICK:
+			// One worker spins, the others wait in the sleep queue.
+			if (benchSpin) {
+				benchSpin = 0;
+				benchTick();
+			} else {
+				semaphoreTakeTimeout(&benchStop, 60000);
+			}
+			break;
+
+		case BENCH_MUTEX:
+			for (i = 0; i < BENCH_ROUNDS; i++) {
+				uint16_t start = TCNT1;
+
+				mutexLock(&benchMutex);
+				mutexUnlock(&benchMutex);
+				benchSample(TCNT1 - start);
+			}
+			break;
+
+		case BENCH_MUTEX_HANDOFF:
+			// Worker holds the mutex and lets the high priority task block
+			// on it, then times the unlock up to the waiter owning it.
+			for (i = 0; i < BENCH_ROUNDS; i++) {
+				if (high) {
+					semaphoreTake(&benchSignal);
+					mutexLock(&benchMutex);
+					benchSample(TCNT1 - benchStamp);
+					mutexUnlock(&benchMutex);
+				} else {
+					mutexLock(&benchMutex);
+					semaphoreGive(&benchSignal);
+					benchStamp = TCNT1;
+					mutexUnlock(&benchMutex);
+				}
+			}
+			break;
+
+		case BENCH_SIGNAL:
+		case BENCH_SIGNAL_NOTIFY:
+			// From the worker signalling to the high priority task
+			// running, woken from its wait.
+			for (i = 0; i < BENCH_ROUNDS; i++) {
+				if (high) {
+					benchWait();
+					benchSample(TCNT1 - benchStamp);
+				} else {
+					benchStamp = TCNT1;
+					#if TASK_NOTIFY
+					if (benchPhase == BENCH_SIGNAL_NOTIFY) {
+						taskNotify(benchHigh, 0, TASK_NOTIFY_INCREMENT);
+						continue;
+					}
+					#endif
+					semaphoreGive(&benchSignal);
+				}
+			}
+			break;
+
+		case BENCH_ISR_IDLE:
+		case BENCH_ISR_PREEMPT:
+		case BENCH_ISR_NOTIFY:
+			// From the compare match to the woken task, while the CPU
+			// sleeps or while a worker spins.
+			if (high) {
+				for (i = 0; i < BENCH_ROUNDS; i++) {
+					benchArm();
+					benchWait();
+					benchSample(TCNT1 - OCR1B);
+				}
+				benchSpin = 0;
+			} else {
+				while (benchSpin) {
+				}
+			}
+			break;
+		}
+
+		semaphoreGive(&benchDone);
+	}
+}
+
+// Hand out go units to that many workers and the high priority task, then
+// wait until each of them is done. The FromISR variant releases all of them
+// before the first one runs.
+static void benchRun(uint8_t phase, uint8_t workers, uint8_t high) {
+	uint8_t i;
+
+	benchPhase = phase;
+	benchStamp = 0;
+	benchReset();
+
+	cli();
+
+	for (i = 0; i < workers; i++) {
+		semaphoreGiveFromISR(&benchGo);
+	}
+
+	if (high) {
+		semaphoreGiveFromISR(&benchGoHigh);
+	}
+
+	sei();
+
+	for (i = 0; i < workers + high; i++) {
+		semaphoreTake(&benchDone);
+	}
+}
+
+static void benchController(void *data) {
+	benchPuts("bench,name,tasks,samples,min,avg,max\r\n");
+
+	benchRun(BENCH_YIELD, BENCH_TASKS, 0);
+	benchReport("yield", BENCH_TASKS);
+
+	benchSpin = 1;
+	benchRun(BENCH_TICK, BENCH_TASKS, 0);
+	benchReport("tick", BENCH_TASKS - 1);
+
+	benchRun(BENCH_MUTEX, 1, 0);
+	benchReport("mutex_uncontended", 1);
+
+	benchRun(BENCH_MUTEX_HANDOFF, 1, 1);
+	benchReport("mutex_handoff", 2);
+
+	benchSpin = 1;
+	benchRun(BENCH_ISR_IDLE, 0, 1);
+	benchReport("isr_wake_idle", 1);
+
+	benchSpin = 1;
+	benchRun(BENCH_ISR_PREEMPT, 1, 1);
+	benchReport("isr_wake_preempt", 2);
+
+	benchRun(BENCH_SIGNAL, 1, 1);
+	benchReport("signal", 2);
+
+	#if TASK_NOTIFY
+	benchRun(BENCH_SIGNAL_NOTIFY, 1, 1);
+	benchReport("signal_notify", 2);
+
+	benchSpin = 1;
+	benchRun(BENCH_ISR_NOTIFY, 1, 1);
+	benchReport("isr_wake_notify", 2);
+	#endif
+
+	// Wait for the last line to leave the shift register.
+	UCSR0A |= _BV(TXC0);
+	benchPuts("bench,done\r\n");
+	while (!(UCSR0A & _BV(TXC0))) {
+	}
+
+	// simavr stops on sleep with interrupts disabled.
+	cli();
+	set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+	sleep_enable();
+	sleep_cpu();
+}
+
+static Task *benchCreate(TaskFunction fn, void *data, uint8_t priority) {
+	Task *t = taskCreatePrio(fn, data, priority);
+
+	if (!t) {
+		benchPuts("bench,error,arena\r\n");
+
+		for (;;) {
+		}
+	}
+
+	return t;
+}
+
+int main(void) {
+	uint8_t i;
+
+	// 115200 baud, 8N1.
+	UCSR0A = _BV(U2X0);
+	UBRR0 = F_CPU / 8 / 115200 - 1;
+	UCSR0B = _BV(TXEN0);
+	UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+
+	// TIMER1 counts CPU cycles.
+	TCCR1A = 0;
+	TCCR1B = _BV(CS10);
+
+	taskInit();
+
+	semaphoreInit(&benchGo, 0);
+	semaphoreInit(&benchGoHigh, 0);
+	semaphoreInit(&benchDone, 0);
+	semaphoreInit(&benchSignal, 0);
+	semaphoreInit(&benchStop, 0);
+	mutexInit(&benchMutex);
+
+	for (i = 0; i < BENCH_TASKS; i++) {
+		benchCreate(benchTask, 0, 1);
+	}
+
+	benchHigh = benchCreate(benchTask, &benchGoHigh, 2);
+	benchCreate(benchController, 0, 0);
+
+	taskStart();
+}
@@ -0,0 +1,157 @@
+/*
+ * config.h
+ *
+ * Created: 10/16/2026 6:04:51 PM
+ *  Author: Alex Ionita
+ */ 
+
+
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+// Build configuration of the kernel. Every setting can also be given on the
+// compiler command line, which wins over the value here. Modules that are
+// switched off compile to nothing, so all .c files can stay in the build.
+
+// CPU clock, Hz.
+#if defined(__AVR__) && !defined(F_CPU)
+#define F_CPU 16000000L
+#endif
+
+// Tick period in milliseconds, 1000 must be a multiple of it.
+#ifndef MS_PER_TICK
+#define MS_PER_TICK 2
+#endif
+
+// Absolute tick count. Compared wrap-safe, a uint16_t saves RAM but then
+// wraps every 65536 ticks, too soon for TASK_CPU_STATS and for
+// timerStartUs().
+#ifndef TASK_TICK_T
+#define TASK_TICK_T uint32_t
+#endif
+
+// Number of priority levels, at most 8 so the ready bitmap fits a byte.
+#ifndef TASK_PRIORITIES
+#define TASK_PRIORITIES 8
+#endif
+
+// Memory sizes (TASK_ARENA_SIZE, TASK_SCHEDULER_STACK, TASK_STACK_DEFAULT,
+// TASK_STACK_MIN) default per port, see task.h and port_host.h. Define
+// them here to change them.
+
+// Task slots of TASK_STACK_DEFAULT bytes kept in a pool besides the arena.
+// taskCreate() and taskCreatePrio() take these first, and taskDelete()
+// gives them back for reuse. Needs TASK_POOL.
+#ifndef TASK_POOL_TASKS
+#define TASK_POOL_TASKS 0
+#endif
+
+// Round-robin time slice in ticks: a task that ran this long gives way to
+// a ready task of the same priority. 0 lets it run until it blocks or
+// yields.
+#ifndef TASK_QUANTUM
+#define TASK_QUANTUM 1
+#endif
+
+#if TASK_QUANTUM > 255
+#error "TASK_QUANTUM must not exceed 255"
+#endif
+
+// Bytes of the stack TASK_ISR handlers run on, the tick included (AVR).
+// 0 runs them on the stack of whatever they interrupted, which every task
+// stack then has to leave room for.
+#ifndef TASK_ISR_STACK
+#define TASK_ISR_STACK 0
+#endif
+
+// Kernel features, 1 to enable.
+
+// Stackless tasks, taskCreateCoroutine() and coroutine.h. They run on the
+// scheduler stack, raise TASK_SCHEDULER_STACK to fit the deepest one plus
+// an interrupt frame.
+#ifndef TASK_COROUTINES
+#define TASK_COROUTINES 0
+#endif
+
+// Stretch the tick while idle and nothing is due (AVR).
+#ifndef TASK_TICKLESS
+#define TASK_TICKLESS 0
+#endif
+
+// Direct to task notifications, taskNotify() and taskNotifyWait(). Adds
+// 3 bytes to every TCB.
+#ifndef TASK_NOTIFY
+#define TASK_NOTIFY 0
+#endif
+
+// Check each task's stack bottom on every switch, and the scheduler's.
+#ifndef TASK_STACK_CHECK
+#define TASK_STACK_CHECK 0
+#endif
+
+// Per task CPU time, taskCpuTime() and taskCpuSnapshot().
+#ifndef TASK_CPU_STATS
+#define TASK_CPU_STATS 0
+#endif
+
+// Earliest deadline first instead of fixed priorities.
+#ifndef TASK_SCHED_EDF
+#define TASK_SCHED_EDF 0
+#endif
+
+// Scheduler event trace, trace.c.
+#ifndef TASK_TRACE
+#define TASK_TRACE 0
+#endif
+
+// Wall clock counters, taskAddSecond() and friends.
+#ifndef TASK_COUNT_SEC
+#define TASK_COUNT_SEC 0
+#endif
+
+#ifndef TASK_COUNT_MSEC
+#define TASK_COUNT_MSEC 0
+#endif
+
+#ifndef TASK_COUNT_USEC
+#define TASK_COUNT_USEC 0
+#endif
+
+// Modules, 1 to build them.
+
+// mutex.c
+#ifndef TASK_MUTEX
+#define TASK_MUTEX 1
+#endif
+
+// semaphore.c
+#ifndef TASK_SEMAPHORE
+#define TASK_SEMAPHORE 1
+#endif
+
+// event.c
+#ifndef TASK_EVENT
+#define TASK_EVENT 1
+#endif
+
+// message.c
+#ifndef TASK_MESSAGE
+#define TASK_MESSAGE 1
+#endif
+
+// pool.c
+#ifndef TASK_POOL
+#define TASK_POOL 1
+#endif
+
+// ring.c
+#ifndef TASK_RING
+#define TASK_RING 1
+#endif
+
+// timer.c, which takes the TIMER0 COMPB interrupt on AVR.
+#ifndef TASK_TIMER
+#define TASK_TIMER 1
+#endif
+
+#endif /* CONFIG_H_ */
@@ -0,0 +1,58 @@
+/*
+ * coroutine.h
+ *
+ * Created: 10/16/2026 7:26:17 PM
+ *  Author: Alex Ionita
+ */ 
+
+
+#ifndef COROUTINE_H_
+#define COROUTINE_H_
+
+#include "task.h"
+
+// Stackless tasks, built with TASK_COROUTINES=1. The body is a function
+// the scheduler calls each time the task runs, and which returns when it
+// waits. A switch on t->line jumps back to where it left off:
+//
+//   static void blink(Task *t, void *data) {
+//       CO_BEGIN(t);
+//       for (;;) {
+//           PORTB ^= _BV(PORTB5);
+//           CO_SLEEP(t, 500);
+//       }
+//       CO_END(t);
+//   }
+//
+//   taskCreateCoroutine(blink, 0, 1);
+//
+// Local variables do not survive a wait, keep state in data. A coroutine
+// is never preempted: interrupts still run, but a task they wake waits
+// until the coroutine returns or waits. Only taskSleep(), semaphoreTake()
+// and mutexLock() may be waited on, they hand the unit or the lock over
+// before the coroutine resumes. Other blocking calls lose their result.
+
+#define CO_BEGIN(t) switch ((t)->line) { case 0:
+
+// Park the task for good.
+#define CO_END(t) } (t)->line = 0; taskSuspend(0)
+
+// Make call, which may block, and go on once it is done.
+#define CO_WAIT(t, call) \
+	do { \
+		(t)->line = __LINE__; \
+		call; \
+		case __LINE__:; \
+	} while (0)
+
+#define CO_SLEEP(t, ms) CO_WAIT(t, taskSleep(ms))
+
+// Let the tasks of the same priority run, then go on.
+#define CO_YIELD(t) \
+	do { \
+		(t)->line = __LINE__; \
+		return; \
+		case __LINE__:; \
+	} while (0)
+
+#endif /* COROUTINE_H_ */
@@ -0,0 +1,167 @@
+/*
+ * event.c
+ *
+ * Created: 10/16/2026 9:41:52 AM
+ *  Author: Alex Ionita
+ */ 
+
+#include "event.h"
+
+#include "task.h"
+
+#if TASK_EVENT
+
+// What a waiting task asked for, kept on its stack behind waitData.
+typedef struct {
+	EventBits bits;
+	uint8_t flags;
+	EventBits result;
+} EventWait;
+
+void eventInit(EventGroup *e) {
+	e->bits = 0;
+	QUEUE_INIT(&e->waiting);
+}
+
+static uint8_t eventMatch(EventBits set, EventBits bits, uint8_t flags) {
+	if (flags & EVENT_WAIT_ALL) {
+		return (set & bits) == bits;
+	}
+
+	return (set & bits) != 0;
+}
+
+// Wake the satisfied waiters without switching to any of them.
+static EventBits eventSetInternal(EventGroup *e, EventBits bits) {
+	EventBits clear = 0;
+	EventWait *w;
+	QUEUE *q, *n;
+	Task *t;
+
+	e->bits |= bits;
+
+	for (q = QUEUE_HEAD(&e->waiting); q != &e->waiting; q = n) {
+		n = QUEUE_NEXT(q);
+		t = QUEUE_DATA(q, Task, member);
+		w = t->waitData;
+
+		if (eventMatch(e->bits, w->bits, w->flags)) {
+			w->result = e->bits;
+
+			if (w->flags & EVENT_CLEAR) {
+				clear |= w->bits;
+			}
+
+			taskWakeupFromISR(t);
+		}
+	}
+
+	e->bits &= ~clear;
+
+	return e->bits;
+}
+
+EventBits eventSet(EventGroup *e, EventBits bits) {
+	PortIrqState irq;
+	EventBits result;
+
+	irq = portIrqSave();
+
+	result = eventSetInternal(e, bits);
+	taskPreempt();
+
+	portIrqRestore(irq);
+
+	return result;
+}
+
+EventBits eventSetFromISR(EventGroup *e, EventBits bits) {
+	PortIrqState irq;
+	EventBits result;
+
+	irq = portIrqSave();
+
+	result = eventSetInternal(e, bits);
+
+	portIrqRestore(irq);
+
+	return result;
+}
+
+EventBits eventClear(EventGroup *e, EventBits bits) {
+	PortIrqState irq;
+	EventBits result;
+
+	irq = portIrqSave();
+
+	e->bits &= ~bits;
+	result = e->bits;
+
+	portIrqRestore(irq);
+
+	return result;
+}
+
+// ms of 0 waits forever, the public API maps "no wait" before calling.
+static EventBits eventWaitInternal(EventGroup *e, EventBits bits, uint8_t flags, uint16_t ms) {
+	EventWait w;
+	Task *t;
+
+	w.bits = bits;
+	w.flags = flags;
+
+	t = taskCurrent();
+	t->waitData = &w;
+
+	if (ms == 0) {
+		taskSuspendPrio(&e->waiting);
+	} else if (taskSuspendTimeout(&e->waiting, ms)) {
+		return e->bits;
+	}
+
+	return w.result;
+}
+
+EventBits eventWait(EventGroup *e, EventBits bits, uint8_t flags) {
+	PortIrqState irq;
+	EventBits result;
+
+	irq = portIrqSave();
+
+	result = e->bits;
+
+	if (eventMatch(result, bits, flags)) {
+		if (flags & EVENT_CLEAR) {
+			e->bits &= ~bits;
+		}
+	} else {
+		result = eventWaitInternal(e, bits, flags, 0);
+	}
+
+	portIrqRestore(irq);
+
+	return result;
+}
+
+EventBits eventWaitTimeout(EventGroup *e, EventBits bits, uint8_t flags, uint16_t ms) {
+	PortIrqState irq;
+	EventBits result;
+
+	irq = portIrqSave();
+
+	result = e->bits;
+
+	if (eventMatch(result, bits, flags)) {
+		if (flags & EVENT_CLEAR) {
+			e->bits &= ~bits;
+		}
+	} else if (ms) {
+		result = eventWaitInternal(e, bits, flags, ms);
+	}
+
+	portIrqRestore(irq);
+
+	return result;
+}
+
+#endif // TASK_EVENT
@@ -0,0 +1,53 @@
+/*
+ * event.h
+ *
+ * Created: 10/16/2026 9:40:18 AM
+ *  Author: Alex Ionita
+ */ 
+
+
+#ifndef EVENT_H_
+#define EVENT_H_
+
+#include <stdint.h>
+
+#include "queue.h"
+
+#ifndef EVENT_BITS_T
+#define EVENT_BITS_T uint8_t
+#endif
+
+typedef EVENT_BITS_T EventBits;
+
+// Flags for eventWait().
+#define EVENT_WAIT_ANY 0 // Return when any of the bits is set.
+#define EVENT_WAIT_ALL 1 // Return when all of the bits are set.
+#define EVENT_CLEAR 2 // Clear the awaited bits before returning.
+
+typedef struct EventGroupStruct EventGroup;
+
+struct EventGroupStruct {
+	EventBits bits;
+	QUEUE waiting; // Waiters, highest priority first.
+};
+
+void eventInit(EventGroup *e);
+
+// Set bits and wake every waiter they satisfy. Returns the bits left set.
+EventBits eventSet(EventGroup *e, EventBits bits);
+
+// Same from an interrupt. End the ISR with taskPreempt().
+EventBits eventSetFromISR(EventGroup *e, EventBits bits);
+
+EventBits eventClear(EventGroup *e, EventBits bits);
+
+// Returns the group's bits when the wait was satisfied.
+EventBits eventWait(EventGroup *e, EventBits bits, uint8_t flags);
+
+// Wait at most ms milliseconds, 0 does not wait at all. On a timeout the
+// current bits are returned, which do not satisfy the wait.
+EventBits eventWaitTimeout(EventGroup *e, EventBits bits, uint8_t flags, uint16_t ms);
+
+
+
+#endif /* EVENT_H_ */
\ No newline at end of file
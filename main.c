@@ -30,8 +30,11 @@ while(1)
 }
 
 void blink_task_white(void *unused) {
+	TASK_TICK_T lastWake = taskTickCount();
+
+	// Toggle every 500ms on the dot, whatever the loop body costs.
 	while (1) {
-		taskSleep(500);
+		taskDelayUntil(&lastWake, TASK_MS_TO_TICKS(500));
 		PORTB ^= _BV(PB3);
 	}
 }
@@ -58,8 +61,9 @@ int main() {
 	mutexInit(&m);
 	taskInit();
 
-	taskCreate(blink_task_white, NULL);
-	taskCreate(blink_task_red, NULL);
+	// The blink tasks only toggle a pin, a small stack is enough.
+	taskCreateEx(blink_task_white, NULL, 128);
+	taskCreateEx(blink_task_red, NULL, 128);
 	taskCreate(blink_task_board, NULL);
 	taskCreate(change_task, NULL);
 	
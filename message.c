@@ -0,0 +1,182 @@
+/*
+ * message.c
+ *
+ * Created: 10/16/2026 11:03:10 AM
+ *  Author: Alex Ionita
+ */ 
+
+#include "message.h"
+
+#include "task.h"
+
+#if TASK_MESSAGE
+
+void messageInit(MessageQueue *q, void **buffer, uint8_t size) {
+	q->buffer = buffer;
+	q->size = size;
+	q->head = 0;
+	q->count = 0;
+	QUEUE_INIT(&q->receivers);
+	QUEUE_INIT(&q->senders);
+}
+
+static Task *messageWaiter(QUEUE *h) {
+	if (QUEUE_EMPTY(h)) {
+		return 0;
+	}
+
+	return QUEUE_DATA(QUEUE_HEAD(h), Task, member);
+}
+
+static void messagePush(MessageQueue *q, void *msg) {
+	// Up to 2 * 255 - 1, summed wide enough not to wrap.
+	uint16_t i = (uint16_t)q->head + q->count;
+
+	if (i >= q->size) {
+		i -= q->size;
+	}
+
+	q->buffer[i] = msg;
+	q->count++;
+}
+
+static void *messagePop(MessageQueue *q) {
+	void *msg = q->buffer[q->head];
+
+	if (++q->head == q->size) {
+		q->head = 0;
+	}
+
+	q->count--;
+
+	return msg;
+}
+
+// Deliver without blocking. Returns the task to wake, if any, or sets
+// *full when there was no room.
+static Task *messagePost(MessageQueue *q, void *msg, uint8_t *full) {
+	Task *t = messageWaiter(&q->receivers);
+
+	*full = 0;
+
+	if (t) {
+		// A receiver is waiting, so the buffer is empty. Hand it over.
+		t->waitData = msg;
+	} else if (q->count < q->size) {
+		messagePush(q, msg);
+	} else {
+		*full = 1;
+	}
+
+	return t;
+}
+
+// ms of 0 waits forever, the public API maps "no wait" before calling.
+static uint8_t messageSendInternal(MessageQueue *q, void *msg, uint16_t ms, uint8_t wait) {
+	uint8_t result = MESSAGE_OK;
+	PortIrqState irq;
+	uint8_t full;
+	Task *t;
+
+	irq = portIrqSave();
+
+	t = messagePost(q, msg, &full);
+
+	if (t) {
+		taskWakeup(t);
+	} else if (full) {
+		if (!wait) {
+			result = MESSAGE_TIMEOUT;
+		} else {
+			// The receiver that makes room takes msg from waitData.
+			taskCurrent()->waitData = msg;
+
+			if (ms == 0) {
+				taskSuspendPrio(&q->senders);
+			} else if (taskSuspendTimeout(&q->senders, ms)) {
+				result = MESSAGE_TIMEOUT;
+			}
+		}
+	}
+
+	portIrqRestore(irq);
+
+	return result;
+}
+
+void messageSend(MessageQueue *q, void *msg) {
+	messageSendInternal(q, msg, 0, 1);
+}
+
+uint8_t messageSendTimeout(MessageQueue *q, void *msg, uint16_t ms) {
+	return messageSendInternal(q, msg, ms, ms != 0);
+}
+
+uint8_t messageSendFromISR(MessageQueue *q, void *msg) {
+	PortIrqState irq;
+	uint8_t full;
+	Task *t;
+
+	irq = portIrqSave();
+
+	t = messagePost(q, msg, &full);
+
+	if (t) {
+		taskWakeupFromISR(t);
+	}
+
+	portIrqRestore(irq);
+
+	return full ? MESSAGE_TIMEOUT : MESSAGE_OK;
+}
+
+static uint8_t messageReceiveInternal(MessageQueue *q, void **msg, uint16_t ms, uint8_t wait) {
+	uint8_t result = MESSAGE_OK;
+	PortIrqState irq;
+	Task *t;
+
+	irq = portIrqSave();
+
+	t = messageWaiter(&q->senders);
+
+	if (q->count) {
+		*msg = messagePop(q);
+
+		// Room was made, the first waiting sender can go into the buffer.
+		if (t) {
+			messagePush(q, t->waitData);
+			taskWakeup(t);
+		}
+	} else if (t) {
+		// Only happens with a size of 0: take it from the sender directly.
+		*msg = t->waitData;
+		taskWakeup(t);
+	} else if (!wait) {
+		result = MESSAGE_TIMEOUT;
+	} else if (ms == 0) {
+		taskSuspendPrio(&q->receivers);
+		*msg = taskCurrent()->waitData;
+	} else if (taskSuspendTimeout(&q->receivers, ms)) {
+		result = MESSAGE_TIMEOUT;
+	} else {
+		*msg = taskCurrent()->waitData;
+	}
+
+	portIrqRestore(irq);
+
+	return result;
+}
+
+void *messageReceive(MessageQueue *q) {
+	void *msg;
+
+	messageReceiveInternal(q, &msg, 0, 1);
+
+	return msg;
+}
+
+uint8_t messageReceiveTimeout(MessageQueue *q, void **msg, uint16_t ms) {
+	return messageReceiveInternal(q, msg, ms, ms != 0);
+}
+
+#endif // TASK_MESSAGE
@@ -0,0 +1,53 @@
+/*
+ * message.h
+ *
+ * Created: 10/16/2026 11:02:31 AM
+ *  Author: Alex Ionita
+ */ 
+
+
+#ifndef MESSAGE_H_
+#define MESSAGE_H_
+
+#include <stdint.h>
+
+#include "queue.h"
+
+// Results of the timed and ISR message functions.
+#define MESSAGE_OK 0
+#define MESSAGE_TIMEOUT 1
+
+typedef struct MessageQueueStruct MessageQueue;
+
+// Ring buffer of message pointers. Only the pointer is passed, the message
+// itself (usually a pool block) is handed over without copying.
+struct MessageQueueStruct {
+	void **buffer;
+	uint8_t size;
+	uint8_t head; // Oldest message.
+	uint8_t count;
+	QUEUE receivers; // Tasks waiting for a message, highest priority first.
+	QUEUE senders; // Tasks waiting for room, highest priority first.
+};
+
+// buffer holds size message pointers. A size of 0 makes every send wait
+// for a receiver.
+void messageInit(MessageQueue *q, void **buffer, uint8_t size);
+
+void messageSend(MessageQueue *q, void *msg);
+
+// Wait at most ms milliseconds for room, 0 does not wait at all.
+uint8_t messageSendTimeout(MessageQueue *q, void *msg, uint16_t ms);
+
+// Never waits, returns MESSAGE_TIMEOUT when the queue is full. End the ISR
+// with taskPreempt().
+uint8_t messageSendFromISR(MessageQueue *q, void *msg);
+
+void *messageReceive(MessageQueue *q);
+
+// Wait at most ms milliseconds for a message, 0 does not wait at all.
+uint8_t messageReceiveTimeout(MessageQueue *q, void **msg, uint16_t ms);
+
+
+
+#endif /* MESSAGE_H_ */
\ No newline at end of file
@@ -4,48 +4,129 @@
  * Created: 1/8/2019 8:18:07 PM
  *  Author: Alex Ionita
  */ 
-#include <avr/interrupt.h>
 
 #include "mutex.h"
 
 #include "task.h"
+#include "trace.h"
+
+#if TASK_MUTEX
 
 void mutexInit(Mutex *m) {
 	m->status = MUTEX_UNLOCKED;
+	m->owner = 0;
 	QUEUE_INIT(&m->waiting);
 }
 
 void mutexLock(Mutex *m) {
-	uint8_t sreg;
+	PortIrqState irq;
+	Task *t;
+
+	irq = portIrqSave();
 
-	sreg = SREG;
-	cli();
+	t = taskCurrent();
 
 	if (m->status == MUTEX_LOCKED) {
-		taskSuspend(&m->waiting);
+		TRACE_TASK(TRACE_MUTEX_WAIT, t);
+		// Lend our priority to the owner so it can get out of our way.
+		taskPriorityInherit(m->owner, t);
+		taskSuspendPrio(&m->waiting);
+		// mutexUnlock() has made us the owner.
 		} else {
 		m->status = MUTEX_LOCKED;
+		m->owner = t;
+		t->mutexes++;
+		TRACE_TASK(TRACE_MUTEX_LOCK, t);
+	}
+
+	portIrqRestore(irq);
+}
+
+uint8_t mutexLockTimeout(Mutex *m, uint16_t ms) {
+	PortIrqState irq;
+	uint8_t result = MUTEX_OK;
+	Task *owner;
+	Task *t;
+
+	irq = portIrqSave();
+
+	t = taskCurrent();
+
+	if (m->status == MUTEX_UNLOCKED) {
+		m->status = MUTEX_LOCKED;
+		m->owner = t;
+		t->mutexes++;
+		TRACE_TASK(TRACE_MUTEX_LOCK, t);
+	} else if (ms == 0) {
+		result = MUTEX_TIMEOUT;
+	} else {
+		TRACE_TASK(TRACE_MUTEX_WAIT, t);
+		owner = m->owner;
+		taskPriorityInherit(owner, t);
+
+		if (taskSuspendTimeout(&m->waiting, ms)) {
+			result = MUTEX_TIMEOUT;
+
+			// The owner may have inherited a priority only we needed. With
+			// more than one mutex held it keeps it until the last unlock.
+			// Between the timeout and now the owner may have unlocked,
+			// which already dropped what it inherited, and someone else
+			// may hold the lock.
+			if (m->owner == owner && owner->mutexes == 1) {
+				taskPriorityRestore(owner);
+
+				if (!QUEUE_EMPTY(&m->waiting)) {
+					taskPriorityInherit(owner, QUEUE_DATA(QUEUE_HEAD(&m->waiting), Task, member));
+				}
+			}
+		}
 	}
 
-	SREG = sreg;
+	portIrqRestore(irq);
+
+	return result;
+}
+
+uint8_t mutexTryLock(Mutex *m) {
+	return mutexLockTimeout(m, 0);
 }
 
 void mutexUnlock(Mutex *m) {
-	uint8_t sreg;
+	PortIrqState irq;
 	QUEUE *q;
 	Task *t;
 
-	sreg = SREG;
-	cli();
+	irq = portIrqSave();
+
+	// Not locked, or not by us.
+	if (m->owner != taskCurrent()) {
+		portIrqRestore(irq);
+		return;
+	}
+
+	TRACE_TASK(TRACE_MUTEX_UNLOCK, m->owner);
+	m->owner->mutexes--;
 
 	if (QUEUE_EMPTY(&m->waiting)) {
 		m->status = MUTEX_UNLOCKED;
+		m->owner = 0;
 		} else {
+		// Hand the lock straight to the highest priority waiter.
 		q = QUEUE_HEAD(&m->waiting);
 		t = QUEUE_DATA(q, Task, member);
-		QUEUE_REMOVE(q);
+		m->owner = t;
+		t->mutexes++;
+		TRACE_TASK(TRACE_MUTEX_LOCK, t);
 		taskWakeup(t);
 	}
 
-	SREG = sreg;
+	// Inherited priority is only dropped once no mutex is held any more.
+	t = taskCurrent();
+	if (t->mutexes == 0) {
+		taskPriorityRestore(t);
+	}
+
+	portIrqRestore(irq);
 }
+
+#endif // TASK_MUTEX
@@ -10,19 +10,31 @@
 #define MUTEX_H_
 #define MUTEX_UNLOCKED 0
 #define MUTEX_LOCKED 1
+
+// Results of mutexLockTimeout() and mutexTryLock().
+#define MUTEX_OK 0
+#define MUTEX_TIMEOUT 1
 #include "queue.h"
+#include "task.h"
 
 typedef struct MutexStruct Mutex;
 
 struct MutexStruct {
 	unsigned status:1;
-	QUEUE waiting;
+	Task *owner; // Task holding the lock, it inherits the waiters' priority.
+	QUEUE waiting; // Waiters, highest priority first.
 };
 
 void mutexInit(Mutex *mutex);
 
 void mutexLock(Mutex *mutex);
 
+// Wait at most ms milliseconds for the lock, 0 does not wait at all.
+uint8_t mutexLockTimeout(Mutex *mutex, uint16_t ms);
+
+uint8_t mutexTryLock(Mutex *mutex);
+
+// Does nothing unless the calling task holds the mutex.
 void mutexUnlock(Mutex *mutex);
 
 
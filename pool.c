@@ -0,0 +1,83 @@
+/*
+ * pool.c
+ *
+ * Created: 10/16/2026 6:38:45 PM
+ *  Author: Alex Ionita
+ */ 
+
+#include "pool.h"
+
+#if TASK_POOL
+
+void poolInit(Pool *p, void *buffer, uint16_t size, uint8_t count) {
+	uint8_t *block;
+	uint8_t i;
+
+	size = POOL_BLOCK_SIZE(size);
+
+	// Push the last block first, so they are handed out in address order.
+	p->free = 0;
+	for (i = count; i > 0; i--) {
+		block = (uint8_t *)buffer + (i - 1) * size;
+		*(void **)block = p->free;
+		p->free = block;
+	}
+
+	p->count = count;
+	p->inUse = 0;
+	p->peak = 0;
+	p->failures = 0;
+}
+
+void *poolAlloc(Pool *p) {
+	PortIrqState irq;
+	void *block;
+
+	irq = portIrqSave();
+
+	block = p->free;
+	if (block) {
+		p->free = *(void **)block;
+		if (++p->inUse > p->peak) {
+			p->peak = p->inUse;
+		}
+	} else {
+		p->failures++;
+	}
+
+	portIrqRestore(irq);
+
+	return block;
+}
+
+void poolFree(Pool *p, void *block) {
+	PortIrqState irq;
+
+	irq = portIrqSave();
+
+	*(void **)block = p->free;
+	p->free = block;
+	p->inUse--;
+
+	portIrqRestore(irq);
+}
+
+void poolStats(Pool *p, PoolStats *s, uint8_t reset) {
+	PortIrqState irq;
+
+	irq = portIrqSave();
+
+	s->count = p->count;
+	s->inUse = p->inUse;
+	s->peak = p->peak;
+	s->failures = p->failures;
+
+	if (reset) {
+		p->peak = p->inUse;
+		p->failures = 0;
+	}
+
+	portIrqRestore(irq);
+}
+
+#endif // TASK_POOL
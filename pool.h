@@ -0,0 +1,62 @@
+/*
+ * pool.h
+ *
+ * Created: 10/16/2026 6:31:08 PM
+ *  Author: Alex Ionita
+ */ 
+
+
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stdint.h>
+
+#include "task.h"
+
+// Fixed-size block allocator. Allocating and freeing take constant time
+// with interrupts briefly disabled, so both work from ISRs, and the memory
+// never fragments. Typical use is message buffers handed through a
+// MessageQueue: the sender allocates, the receiver frees.
+//
+//   static POOL_BUFFER(frameBuffer, sizeof(Frame), 8);
+//   static Pool frames;
+//   poolInit(&frames, frameBuffer, sizeof(Frame), 8);
+
+// Blocks start on this boundary and hold at least a pointer.
+#define POOL_ALIGN (PORT_ALIGN > sizeof(void *) ? PORT_ALIGN : sizeof(void *))
+
+// Bytes taken by one block of size bytes.
+#define POOL_BLOCK_SIZE(size) (((size) + POOL_ALIGN - 1) / POOL_ALIGN * POOL_ALIGN)
+
+// Declare the storage for count blocks of size bytes.
+#define POOL_BUFFER(name, size, count) \
+	uint8_t name[POOL_BLOCK_SIZE(size) * (count)] __attribute__((aligned(POOL_ALIGN)))
+
+typedef struct {
+	void *free; // First free block, each one starts with the next.
+	uint8_t count;
+	uint8_t inUse;
+	uint8_t peak; // Most blocks in use at once.
+	uint16_t failures; // poolAlloc() calls that found no free block.
+} Pool;
+
+typedef struct {
+	uint8_t count;
+	uint8_t inUse;
+	uint8_t peak;
+	uint16_t failures;
+} PoolStats;
+
+// buffer is count blocks, declared with POOL_BUFFER() of the same size.
+void poolInit(Pool *p, void *buffer, uint16_t size, uint8_t count);
+
+// Returns 0 when all blocks are in use.
+void *poolAlloc(Pool *p);
+
+void poolFree(Pool *p, void *block);
+
+// Copy the counters. With reset set, peak restarts from the blocks in use
+// now and failures from zero.
+void poolStats(Pool *p, PoolStats *s, uint8_t reset);
+
+#endif /* POOL_H_ */
@@ -0,0 +1,60 @@
+/*
+ * port.h
+ *
+ * Created: 10/16/2026 1:01:07 PM
+ *  Author: Alex Ionita
+ */ 
+
+
+#ifndef PORT_H_
+#define PORT_H_
+
+#include "task.h"
+
+// The interface between the scheduler in task.c and an architecture port
+// (port_avr.c or port_host.c). The port owns context switching, the tick
+// source and sleeping while idle, task.c owns every queue.
+
+// Provided by task.c.
+
+// Task running, or 0 while in the scheduler.
+extern Task *currentTask;
+
+// One past the top of the scheduler stack.
+extern uint8_t *const taskSchedulerStack;
+
+// Pick the next task and portSwitch() to it, or portIdle() when there is
+// none. Entered from the start, on the scheduler stack, every time a task
+// is switched out. Interrupts must be disabled.
+void taskScheduler(void) __attribute__((noreturn));
+
+// Account for ticks that passed, waking tasks whose sleep ran out. Returns
+// 1 when the running task is to be switched out, 0 to resume it.
+uint8_t taskAdvance(uint16_t ticks);
+
+// Ticks until the earliest sleeping task is due, 0 when none sleeps.
+uint16_t taskNextWakeup(void);
+
+// Provided by the port, along with taskYield().
+
+void portInit(void);
+
+// Set up t's context so that switching to it calls fn(data), with
+// interrupts enabled. The stack spans t->stackBottom up to t itself.
+void portTaskInit(Task *t, TaskFunction fn, void *data);
+
+// Enable the tick and enter the scheduler.
+void portStart(void) __attribute__((noreturn));
+
+// Resume currentTask. Interrupts must be disabled.
+void portSwitch(void) __attribute__((noreturn));
+
+// Wait for an interrupt, interrupts disabled before and after. May return
+// without waiting when it counted a tick itself.
+void portIdle(void);
+
+// Called by taskPreempt() when a switch is due. Returns 1 when the port
+// takes it over, to switch on the way out of the interrupt running now.
+uint8_t portIsrDefer(void);
+
+#endif /* PORT_H_ */
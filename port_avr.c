@@ -0,0 +1,490 @@
+/*
+ * port_avr.c
+ *
+ * Created: 10/16/2026 1:05:44 PM
+ *  Author: Alex Ionita
+ */ 
+#ifdef __AVR__
+
+#include "port.h"
+
+// Frame kinds stored in Task.frame, tested by taskPop().
+#define TASK_FRAME_FULL 0 // All registers, pushed by TASK_ISR and portIsrSwitch().
+#define TASK_FRAME_CALL 1 // Call-saved registers, pushed by taskPushCall().
+
+
+// Push the part of a task's context a function call must preserve.
+// Only valid when the task gives up the CPU by calling into the kernel:
+// r0, r18-r27, r30, r31 and T are call-clobbered and r1 is zero.
+static inline void taskPushCall(void) __attribute__ ((always_inline));
+static inline void taskPushCall(void) {
+	asm volatile(
+	// Save status register
+	"in r0, 0x3f\n"
+	"cli\n"
+	"push r0\n"
+	// Save call-saved registers
+	"push r2\n"
+	"push r3\n"
+	"push r4\n"
+	"push r5\n"
+	"push r6\n"
+	"push r7\n"
+	"push r8\n"
+	"push r9\n"
+	"push r10\n"
+	"push r11\n"
+	"push r12\n"
+	"push r13\n"
+	"push r14\n"
+	"push r15\n"
+	"push r16\n"
+	"push r17\n"
+	"push r28\n"
+	"push r29\n"
+	// Load currentTask into Z register pair
+	"lds r30, currentTask\n" // Low
+	"lds r31, currentTask+1\n" // High
+	// Save stack pointer in current task struct
+	"in r0, 0x3d\n" // Low
+	"st z+, r0\n"
+	"in r0, 0x3e\n" // High
+	"st z+, r0\n"
+	// Frame kind: TASK_FRAME_CALL
+	"ldi r18, 1\n"
+	"st z, r18\n"
+	);
+}
+
+// Pop a task's context off of its own stack and resume it.
+static void taskPop(void) __attribute__ ((naked));
+static void taskPop(void) {
+	asm volatile(
+	// Restore stack pointer from current task struct
+	"lds r26, currentTask\n" // Low
+	"lds r27, currentTask+1\n" // High
+	"ld r0, x+\n"
+	"out 0x3d, r0\n" // Low
+	"ld r0, x+\n"
+	"out 0x3e, r0\n" // High
+	// Frame kind, anything but TASK_FRAME_FULL is TASK_FRAME_CALL
+	"ld r0, x\n"
+	"tst r0\n"
+	"breq task_pop_full\n"
+	// Restore call-saved registers
+	"pop r29\n"
+	"pop r28\n"
+	"pop r17\n"
+	"pop r16\n"
+	"pop r15\n"
+	"pop r14\n"
+	"pop r13\n"
+	"pop r12\n"
+	"pop r11\n"
+	"pop r10\n"
+	"pop r9\n"
+	"pop r8\n"
+	"pop r7\n"
+	"pop r6\n"
+	"pop r5\n"
+	"pop r4\n"
+	"pop r3\n"
+	"pop r2\n"
+	"clr r1\n"
+	// Restore status register
+	"pop r0\n"
+	"sbrc r0, 7\n" // Skip if bit in register cleared
+	"rjmp task_pop_call_reti\n"
+	"out 0x3f, r0\n"
+	"ret\n"
+	"task_pop_call_reti:\n"
+	"clt\n"
+	"bld r0, 7\n"
+	"out 0x3f, r0\n"
+	"reti\n"
+	"task_pop_full:\n"
+	// Restore general registers
+	"pop r29\n"
+	"pop r28\n"
+	"pop r17\n"
+	"pop r16\n"
+	"pop r15\n"
+	"pop r14\n"
+	"pop r13\n"
+	"pop r12\n"
+	"pop r11\n"
+	"pop r10\n"
+	"pop r9\n"
+	"pop r8\n"
+	"pop r7\n"
+	"pop r6\n"
+	"pop r5\n"
+	"pop r4\n"
+	"pop r3\n"
+	"pop r2\n"
+	"pop r27\n"
+	"pop r26\n"
+	"pop r25\n"
+	"pop r24\n"
+	"pop r23\n"
+	"pop r22\n"
+	"pop r21\n"
+	"pop r20\n"
+	"pop r19\n"
+	"pop r18\n"
+	"pop r1\n"
+	// Restore Z register pair
+	"pop r31\n"
+	"pop r30\n"
+
+	// Restore status register.
+
+	"pop r0\n"
+	"sbrs r0, 7\n" // Skip if bit in register set
+	"jmp task_pop_ret\n"
+	"jmp task_pop_reti\n"
+	"task_pop_ret:\n"
+	"out 0x3f, r0\n" // Restore status register
+	"pop r0\n" // Restore the real r0
+	"ret\n"
+	"task_pop_reti:\n"
+	"clt\n" // Clear T in SREG
+	"bld r0, 7\n" // Bit load from T to r0 bit 7 (interrupt bit)
+	"out 0x3f, r0\n" // Restore status register (without interrupt bit set)
+	"pop r0\n" // Restore the real r0
+	"reti\n"
+	);
+}
+
+
+static void *taskInitializeInternal(void *sp, TaskFunction fn, void *data) {
+	void *result;
+
+	asm volatile(
+	// About to overwrite the stack pointer, disable interrupts
+	"in r18, 0x3f\n" // r18 can be clobbered
+	"cli\n"
+	// Save current stack pointer
+	"in r26, 0x3d\n"
+	"in r27, 0x3e\n"
+	// Set new task's stack pointer
+	"out 0x3d, %A1\n"
+	"out 0x3e, %B1\n"
+	// Store location of task body as return address, such that
+	// executing "ret" after "context_restore" will jump to it.
+	"push %A2\n"
+	"push %B2\n"
+	#ifdef __AVR_3_BYTE_PC__
+	// Push extra zero, assuming the task function is not located
+	// in high program memory (>128KiB).
+	"clr __tmp_reg__\n"
+	"push __tmp_reg__\n"
+	#endif
+	// Store r0
+	"ldi r19, 0\n" // r19 can be clobbered
+	"push r19\n"
+	// Store status register
+	"ldi r19, 0x80\n" // Start task with interrupts enabled
+	"push r19\n"
+	// Store general registers
+	"ldi r19, 0\n"
+	"push r19\n" // r30
+	"push r19\n" // r31
+	"push r19\n" // r1
+	"push r19\n" // r18
+	"push r19\n" // r19
+	"push r19\n" // r20
+	"push r19\n" // r21
+	"push r19\n" // r22
+	"push r19\n" // r23
+	// Argument to task function
+	"push %A3\n" // r24
+	"push %B3\n" // r25
+	"push r19\n" // r26
+	"push r19\n" // r27
+	"push r19\n" // r2
+	"push r19\n" // r3
+	"push r19\n" // r4
+	"push r19\n" // r5
+	"push r19\n" // r6
+	"push r19\n" // r7
+	"push r19\n" // r8
+	"push r19\n" // r9
+	"push r19\n" // r10
+	"push r19\n" // r11
+	"push r19\n" // r12
+	"push r19\n" // r13
+	"push r19\n" // r14
+	"push r19\n" // r15
+	"push r19\n" // r16
+	"push r19\n" // r17
+	"push r19\n" // r28
+	"push r19\n" // r29
+	// Store new task's stack pointer at return register
+	"in %A0, 0x3d\n"
+	"in %B0, 0x3e\n"
+	// Restore stack pointer
+	"out 0x3d, r26\n"
+	"out 0x3e, r27\n"
+	// Restore status register
+	"out 0x3f, r18\n"
+	: "=r" (result)
+	: "r" (sp), "r" (fn), "r" (data)
+	: "r18", "r19", "r26", "r27"
+	);
+
+	return result;
+}
+
+
+void portTaskInit(Task *t, TaskFunction fn, void *data) {
+	t->context.stackPointer = taskInitializeInternal((uint8_t *)t - 1, fn, data);
+	t->context.frame = TASK_FRAME_FULL;
+}
+
+// Reset SP to the top of the scheduler stack and run the scheduler from
+// the start. Interrupts must be disabled.
+static inline void taskJmpScheduler(void) __attribute__ ((always_inline));
+static inline void taskJmpScheduler(void) {
+	asm volatile(
+	"out 0x3d, %A0\n"
+	"out 0x3e, %B0\n"
+	"jmp taskScheduler\n"
+	:: "x" (taskSchedulerStack - 1)
+	);
+}
+
+
+#if TASK_TICKLESS
+// Ticks spanned by the stretched idle period, zero while ticking normally.
+static uint8_t taskIdleTicks;
+
+// Counts of the tick prescaler dropped when TCNT0 was scaled down.
+static uint8_t taskIdleRemainder;
+
+// Slow TIMER0 down so the next compare match lands on the earliest
+// deadline. The 8-bit counter at the idle prescaler caps the period at
+// TASK_IDLE_STEP_TICKS * TASK_IDLE_MAX_STEPS ticks, 8 at 16 MHz with 2 ms
+// ticks, after which the CPU wakes and idles again. Returns 0 when a tick
+// was counted instead and the CPU is not to sleep.
+static uint8_t taskIdleEnter(void) {
+	uint16_t ticks = TASK_IDLE_STEP_TICKS * TASK_IDLE_MAX_STEPS;
+	uint16_t next = taskNextWakeup();
+	uint8_t steps;
+	uint8_t count;
+
+	// A timerStartUs() timer is armed on OCR0B against the normal tick.
+	if (TIMSK0 & _BV(OCIE0B)) {
+		return 1;
+	}
+
+	if (next && next < ticks) {
+		ticks = next;
+	}
+
+	steps = ticks / TASK_IDLE_STEP_TICKS;
+	if (steps == 0) {
+		return 1;
+	}
+
+	// Stop the clock, so no compare match can land between the test below
+	// and the reprogramming.
+	TCCR0B = 0;
+
+	// A tick matched while the scheduler ran with interrupts off. Stretched
+	// now, its interrupt would count the whole period for it. Count the one
+	// tick here and keep ticking normally, the scheduler then runs again
+	// for whatever it woke.
+	if (TIFR0 & _BV(OCF0A)) {
+		TIFR0 = _BV(OCF0A);
+		TCCR0B = _TCCR0B;
+		taskAdvance(1);
+		return 0;
+	}
+
+	count = TCNT0;
+
+	TCNT0 = count / TASK_IDLE_PRESCALE;
+	OCR0A = steps * COUNTS_PER_TICK - 1;
+
+	taskIdleRemainder = count % TASK_IDLE_PRESCALE;
+	taskIdleTicks = steps * TASK_IDLE_STEP_TICKS;
+
+	TCCR0B = _TCCR0B_IDLE;
+
+	return 1;
+}
+
+// Restore the normal tick and return the number of ticks that passed.
+// matched is set when called for the compare match ending the period.
+static uint16_t taskIdleExit(uint8_t matched) {
+	uint16_t count;
+	uint16_t ticks = 0;
+
+	// The period may have ended while another interrupt woke us.
+	if (TIFR0 & _BV(OCF0A)) {
+		TIFR0 = _BV(OCF0A);
+		matched = 1;
+	}
+
+	if (matched) {
+		ticks = taskIdleTicks;
+	}
+
+	// Position within the tick, in counts of the tick prescaler.
+	count = TCNT0 * TASK_IDLE_PRESCALE + taskIdleRemainder;
+	ticks += count / COUNTS_PER_TICK;
+
+	TCCR0B = _TCCR0B;
+	OCR0A = COUNTS_PER_TICK - 1;
+	TCNT0 = count % COUNTS_PER_TICK;
+
+	taskIdleTicks = 0;
+
+	return ticks;
+}
+#endif // TASK_TICKLESS
+
+// Returns 1 when the interrupted task is to be switched out.
+static uint8_t taskTick(void) {
+	#if TASK_TICKLESS
+	if (taskIdleTicks) {
+		return taskAdvance(taskIdleExit(1));
+	}
+	#endif
+
+	return taskAdvance(1);
+}
+
+// Most ticks wake nobody and leave the time slice running, those return
+// straight to the task with only the call-clobbered registers saved.
+TASK_ISR(TIMER0_COMPA_vect) {
+	if (taskTick()) {
+		portSwitchPending = 1;
+	}
+}
+
+static void task__setup_timer() {
+	// Waveform generation mode: CTC
+	// WGM02: 0
+	// WGM01: 1
+	// WGM00: 0
+	TCCR0A = _BV(WGM01);
+
+	TCCR0B = _TCCR0B;
+
+	OCR0A = COUNTS_PER_TICK - 1;
+}
+
+void portInit(void) {
+	task__setup_timer();
+
+	#if TASK_TICKLESS
+	// Let "sleep" enter idle mode, where TIMER0 keeps running.
+	SMCR = _BV(SE);
+	#endif
+}
+
+void portStart(void) {
+
+	cli();
+
+
+	TIMSK0 |= _BV(OCIE0A);
+
+
+	taskJmpScheduler();
+	__builtin_unreachable();
+}
+
+void portSwitch(void) {
+	taskPop();
+	__builtin_unreachable();
+}
+
+void portIdle(void) {
+	#if TASK_TICKLESS
+	if (!taskIdleEnter()) {
+		return;
+	}
+	#endif
+
+	sei();
+	asm volatile ("sleep");
+	cli();
+
+	#if TASK_TICKLESS
+	// Woken early by another interrupt, catch up with the ticks missed.
+	if (taskIdleTicks) {
+		taskAdvance(taskIdleExit(0));
+	}
+	#endif
+}
+
+void taskYield(void) __attribute__((naked));
+void taskYield(void) {
+	taskPushCall();
+
+	taskJmpScheduler();
+}
+
+uint8_t portIsrNesting;
+
+uint8_t portSwitchPending;
+
+#if TASK_ISR_STACK
+static uint8_t portIsrStack[TASK_ISR_STACK];
+
+uint8_t *const portIsrStackTop = portIsrStack + TASK_ISR_STACK - 1;
+
+void *portIsrTaskSp;
+#endif
+
+uint8_t portIsrDefer(void) {
+	if (portIsrNesting) {
+		portSwitchPending = 1;
+		return 1;
+	}
+
+	return 0;
+}
+
+// Jumped to by PORT_ISR_EXIT() with the call-clobbered registers pushed.
+// Push the rest to make it a TASK_FRAME_FULL and switch.
+void portIsrSwitch(void) __attribute__((naked, used));
+void portIsrSwitch(void) {
+	asm volatile(
+	"sts portSwitchPending, r1\n"
+	"push r2\n"
+	"push r3\n"
+	"push r4\n"
+	"push r5\n"
+	"push r6\n"
+	"push r7\n"
+	"push r8\n"
+	"push r9\n"
+	"push r10\n"
+	"push r11\n"
+	"push r12\n"
+	"push r13\n"
+	"push r14\n"
+	"push r15\n"
+	"push r16\n"
+	"push r17\n"
+	"push r28\n"
+	"push r29\n"
+	// Save stack pointer in current task struct
+	"lds r30, currentTask\n" // Low
+	"lds r31, currentTask+1\n" // High
+	"in r0, 0x3d\n" // Low
+	"st z+, r0\n"
+	"in r0, 0x3e\n" // High
+	"st z+, r0\n"
+	// Frame kind: TASK_FRAME_FULL
+	"st z, r1\n"
+	);
+
+	taskJmpScheduler();
+}
+
+#endif // __AVR__
@@ -0,0 +1,227 @@
+/*
+ * port_avr.h
+ *
+ * Created: 10/16/2026 1:02:18 PM
+ *  Author: Alex Ionita
+ */ 
+
+
+#ifndef PORT_AVR_H_
+#define PORT_AVR_H_
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+
+// CPU cycles per tick.
+#define TASK_TICK_CYCLES (F_CPU / 1000 * MS_PER_TICK)
+
+// The smallest TIMER0 prescaler that fits a tick in 256 counts.
+#if TASK_TICK_CYCLES <= 256
+#define TASK_PRESCALE 1
+#define _TCCR0B (_BV(CS00))
+#elif TASK_TICK_CYCLES <= 256L * 8
+#define TASK_PRESCALE 8
+#define _TCCR0B (_BV(CS01))
+#elif TASK_TICK_CYCLES <= 256L * 64
+#define TASK_PRESCALE 64
+#define _TCCR0B (_BV(CS01) | _BV(CS00))
+#elif TASK_TICK_CYCLES <= 256L * 256
+#define TASK_PRESCALE 256
+#define _TCCR0B (_BV(CS02))
+#elif TASK_TICK_CYCLES <= 256L * 1024
+#define TASK_PRESCALE 1024
+#define _TCCR0B (_BV(CS02) | _BV(CS00))
+#else
+#error "MS_PER_TICK too long for TIMER0 at this F_CPU"
+#endif
+
+#define COUNTS_PER_TICK (TASK_TICK_CYCLES / TASK_PRESCALE)
+
+#if TASK_TICK_CYCLES % TASK_PRESCALE
+#warning "MS_PER_TICK is not a whole number of TIMER0 counts, time will drift"
+#endif
+
+#if TASK_TICKLESS
+// While idle with nothing due, TIMER0 runs on the next prescaler,
+// TASK_IDLE_PRESCALE times slower, so a compare period spans several ticks.
+#if TASK_PRESCALE == 1
+#define TASK_IDLE_PRESCALE 8
+#define _TCCR0B_IDLE (_BV(CS01))
+#elif TASK_PRESCALE == 8
+#define TASK_IDLE_PRESCALE 8
+#define _TCCR0B_IDLE (_BV(CS01) | _BV(CS00))
+#elif TASK_PRESCALE == 64
+#define TASK_IDLE_PRESCALE 4
+#define _TCCR0B_IDLE (_BV(CS02))
+#elif TASK_PRESCALE == 256
+#define TASK_IDLE_PRESCALE 4
+#define _TCCR0B_IDLE (_BV(CS02) | _BV(CS00))
+#else
+#error "TASK_TICKLESS needs a TIMER0 prescaler below 1024, shorten MS_PER_TICK"
+#endif
+// A whole number of ticks fits COUNTS_PER_TICK slow counts.
+#define TASK_IDLE_STEP_TICKS TASK_IDLE_PRESCALE
+#define TASK_IDLE_MAX_STEPS (256 / COUNTS_PER_TICK)
+#endif
+
+// Stacks and TCBs need no alignment.
+#define PORT_ALIGN 1
+
+// Count within the current tick, 0 to COUNTS_PER_TICK - 1.
+#define portTimerCount() TCNT0
+
+// Set while a tick has passed that the ISR has not handled yet.
+#define portTimerPending() (TIFR0 & _BV(OCF0A))
+
+// Saved context: the rest of it is on the task's own stack. The asm in
+// port_avr.c relies on the offsets of both fields.
+typedef struct {
+	void *stackPointer; // Stack pointer this task can be resumed from.
+	uint8_t frame; // Kind of context saved at stackPointer.
+} PortContext;
+
+// Interrupt state, the status register.
+typedef uint8_t PortIrqState;
+
+// Disable interrupts, returning the previous state.
+static inline PortIrqState portIrqSave(void) {
+	PortIrqState s = SREG;
+
+	cli();
+
+	return s;
+}
+
+static inline void portIrqRestore(PortIrqState s) {
+	SREG = s;
+}
+
+static inline void portIrqEnable(void) {
+	sei();
+}
+
+// Interrupt handler that switches straight to a task it made ready. The
+// entry saves only the call-clobbered registers, the body is an ordinary
+// function. taskPreempt() called in it marks the switch pending and the
+// exit does it: it completes the saved registers into a full task frame
+// and enters the scheduler, or otherwise returns with a plain reti.
+// The body may enable interrupts to let others nest, only the outermost
+// handler switches. With TASK_ISR_STACK the bodies run on a stack of
+// their own, so a task stack only needs room for the 35 byte frame.
+//
+//   TASK_ISR(INT0_vect) {
+//       semaphoreGiveFromISR(&s);
+//       taskPreempt();
+//   }
+#define TASK_ISR(vector) \
+	static void vector##_body(void) __attribute__((noinline, used)); \
+	ISR(vector, ISR_NAKED) { \
+		PORT_ISR_ENTER(); \
+		vector##_body(); \
+		PORT_ISR_EXIT(); \
+	} \
+	static void vector##_body(void)
+
+// Interrupt nesting depth of TASK_ISR handlers.
+extern uint8_t portIsrNesting;
+
+// Set when a TASK_ISR handler is to leave through the scheduler.
+extern uint8_t portSwitchPending;
+
+#if TASK_ISR_STACK
+// Stack pointer for the outermost handler, the top of the interrupt stack.
+extern uint8_t *const portIsrStackTop;
+
+// Stack pointer of the code the outermost handler interrupted.
+extern void *portIsrTaskSp;
+
+// Entered the outermost handler: move to the interrupt stack. r24 holds
+// the new nesting depth.
+#define PORT_ISR_STACK_ENTER \
+	"cpi r24, 1\n" \
+	"brne 1f\n" \
+	"in r24, 0x3d\n" \
+	"sts portIsrTaskSp, r24\n" \
+	"in r24, 0x3e\n" \
+	"sts portIsrTaskSp+1, r24\n" \
+	"lds r24, portIsrStackTop\n" \
+	"out 0x3d, r24\n" \
+	"lds r24, portIsrStackTop+1\n" \
+	"out 0x3e, r24\n" \
+	"1:\n"
+
+// Leaving the outermost handler: back to the interrupted stack, where the
+// frame was pushed.
+#define PORT_ISR_STACK_EXIT \
+	"lds r24, portIsrTaskSp\n" \
+	"out 0x3d, r24\n" \
+	"lds r24, portIsrTaskSp+1\n" \
+	"out 0x3e, r24\n"
+#else
+#define PORT_ISR_STACK_ENTER
+#define PORT_ISR_STACK_EXIT
+#endif
+
+// Push the first part of a full frame, in the order taskPop() takes it.
+// The task was interrupted with interrupts enabled, the saved SREG says so.
+#define PORT_ISR_ENTER() asm volatile( \
+	"push r0\n" \
+	"in r0, 0x3f\n" \
+	"set\n" \
+	"bld r0, 7\n" \
+	"push r0\n" \
+	"push r30\n" \
+	"push r31\n" \
+	"push r1\n" \
+	"clr r1\n" \
+	"push r18\n" \
+	"push r19\n" \
+	"push r20\n" \
+	"push r21\n" \
+	"push r22\n" \
+	"push r23\n" \
+	"push r24\n" \
+	"push r25\n" \
+	"push r26\n" \
+	"push r27\n" \
+	"lds r24, portIsrNesting\n" \
+	"inc r24\n" \
+	"sts portIsrNesting, r24\n" \
+	PORT_ISR_STACK_ENTER \
+	)
+
+#define PORT_ISR_EXIT() asm volatile( \
+	"cli\n" \
+	"lds r24, portIsrNesting\n" \
+	"dec r24\n" \
+	"sts portIsrNesting, r24\n" \
+	"brne 1f\n" \
+	PORT_ISR_STACK_EXIT \
+	"lds r24, portSwitchPending\n" \
+	"tst r24\n" \
+	"breq 1f\n" \
+	"jmp portIsrSwitch\n" \
+	"1:\n" \
+	"pop r27\n" \
+	"pop r26\n" \
+	"pop r25\n" \
+	"pop r24\n" \
+	"pop r23\n" \
+	"pop r22\n" \
+	"pop r21\n" \
+	"pop r20\n" \
+	"pop r19\n" \
+	"pop r18\n" \
+	"pop r1\n" \
+	"pop r31\n" \
+	"pop r30\n" \
+	"pop r0\n" \
+	"clt\n" \
+	"bld r0, 7\n" \
+	"out 0x3f, r0\n" \
+	"pop r0\n" \
+	"reti\n" \
+	)
+
+#endif /* PORT_AVR_H_ */
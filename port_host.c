@@ -0,0 +1,125 @@
+/*
+ * port_host.c
+ *
+ * Created: 10/16/2026 1:07:26 PM
+ *  Author: Alex Ionita
+ */ 
+#ifndef __AVR__
+
+#include <stdlib.h>
+#include <sys/time.h>
+
+#include "port.h"
+
+#if TASK_HOST_VIRTUAL_TIME
+#define PORT_TIMER ITIMER_VIRTUAL
+#else
+#define PORT_TIMER ITIMER_REAL
+#endif
+
+// Where the scheduler starts. Only ever switched to and never saved into,
+// so every switch enters taskScheduler() from the start, as on the AVR.
+static ucontext_t portScheduler;
+
+// First function of every task.
+static void portTaskEntry(void) {
+	currentTask->context.fn(currentTask->context.data);
+
+	// Nothing to return to, park the task for good.
+	for (;;) {
+		taskSuspend(0);
+	}
+}
+
+void portTaskInit(Task *t, TaskFunction fn, void *data) {
+	getcontext(&t->context.uc);
+
+	t->context.uc.uc_stack.ss_sp = t->stackBottom;
+	t->context.uc.uc_stack.ss_size = (uint8_t *)t - t->stackBottom;
+	t->context.uc.uc_link = 0;
+	sigemptyset(&t->context.uc.uc_sigmask);
+
+	makecontext(&t->context.uc, portTaskEntry, 0);
+
+	t->context.fn = fn;
+	t->context.data = data;
+}
+
+// The tick interrupt. Like the TIMER0 ISR it only enters the scheduler
+// when the running task is to be switched out.
+static void portTick(int sig) {
+	(void)sig;
+
+	if (taskAdvance(1)) {
+		swapcontext(&currentTask->context.uc, &portScheduler);
+	}
+}
+
+void portInit(void) {
+	struct sigaction sa;
+
+	getcontext(&portScheduler);
+
+	portScheduler.uc_stack.ss_sp = taskSchedulerStack - TASK_SCHEDULER_STACK;
+	portScheduler.uc_stack.ss_size = TASK_SCHEDULER_STACK;
+	portScheduler.uc_link = 0;
+	PORT_IRQ_SIGNALS(&portScheduler.uc_sigmask);
+
+	makecontext(&portScheduler, taskScheduler, 0);
+
+	sa.sa_handler = portTick;
+	sa.sa_flags = SA_RESTART;
+	PORT_IRQ_SIGNALS(&sa.sa_mask);
+	sigaction(PORT_TICK_SIGNAL, &sa, 0);
+}
+
+void portStart(void) {
+	struct itimerval it;
+
+	portIrqSave();
+
+	it.it_interval.tv_sec = 0;
+	it.it_interval.tv_usec = US_PER_TICK;
+	it.it_value = it.it_interval;
+	setitimer(PORT_TIMER, &it, 0);
+
+	setcontext(&portScheduler);
+	abort();
+}
+
+void portSwitch(void) {
+	setcontext(&currentTask->context.uc);
+	abort();
+}
+
+void portIdle(void) {
+	sigset_t set;
+
+	#if TASK_HOST_VIRTUAL_TIME
+	// Idle time costs no CPU time, skip straight to the next wake-up.
+	uint16_t ticks = taskNextWakeup();
+
+	if (ticks) {
+		taskAdvance(ticks);
+		return;
+	}
+	#endif
+
+	sigemptyset(&set);
+	sigsuspend(&set);
+}
+
+// Signal handlers switch from inside the handler, see taskPreempt().
+uint8_t portIsrDefer(void) {
+	return 0;
+}
+
+void taskYield(void) {
+	PortIrqState irq = portIrqSave();
+
+	swapcontext(&currentTask->context.uc, &portScheduler);
+
+	portIrqRestore(irq);
+}
+
+#endif // __AVR__
@@ -0,0 +1,90 @@
+/*
+ * port_host.h
+ *
+ * Created: 10/16/2026 1:03:51 PM
+ *  Author: Alex Ionita
+ */ 
+
+
+#ifndef PORT_HOST_H_
+#define PORT_HOST_H_
+
+#include <signal.h>
+#include <ucontext.h>
+
+// Tasks are ucontexts, the tick is a timer signal. With TASK_HOST_VIRTUAL_TIME
+// the tick follows the CPU time used by the process and idle periods are
+// skipped, otherwise it follows the wall clock.
+#if TASK_HOST_VIRTUAL_TIME
+#define PORT_TICK_SIGNAL SIGVTALRM
+#else
+#define PORT_TICK_SIGNAL SIGALRM
+#endif
+
+// Signals standing in for interrupts. All of them are blocked while
+// interrupts are disabled, raise SIGUSR1 or SIGUSR2 to simulate a device.
+#define PORT_IRQ_SIGNALS(set) \
+	(sigemptyset(set), sigaddset(set, PORT_TICK_SIGNAL), \
+	sigaddset(set, SIGUSR1), sigaddset(set, SIGUSR2))
+
+#define COUNTS_PER_TICK 1
+
+#ifndef TASK_ARENA_SIZE
+#define TASK_ARENA_SIZE (1024 * 1024L)
+#endif
+
+// Signal handlers run on the interrupted stack, leave room for their frames.
+#ifndef TASK_SCHEDULER_STACK
+#define TASK_SCHEDULER_STACK 16384
+#endif
+
+#ifndef TASK_STACK_DEFAULT
+#define TASK_STACK_DEFAULT 16384
+#endif
+
+#ifndef TASK_STACK_MIN
+#define TASK_STACK_MIN 8192
+#endif
+
+// Stacks and TCBs are carved on 16 byte boundaries, as the x86-64 ABI wants.
+#define PORT_ALIGN 16
+
+#define portTimerCount() 0
+#define portTimerPending() 0
+
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define _BV(bit) (1 << (bit))
+
+typedef struct {
+	ucontext_t uc;
+	TaskFunction fn;
+	void *data;
+} PortContext;
+
+// Nonzero when interrupts were already disabled.
+typedef uint8_t PortIrqState;
+
+static inline PortIrqState portIrqSave(void) {
+	sigset_t set, old;
+
+	PORT_IRQ_SIGNALS(&set);
+	sigprocmask(SIG_BLOCK, &set, &old);
+
+	return sigismember(&old, PORT_TICK_SIGNAL);
+}
+
+static inline void portIrqRestore(PortIrqState s) {
+	sigset_t set;
+
+	if (!s) {
+		PORT_IRQ_SIGNALS(&set);
+		sigprocmask(SIG_UNBLOCK, &set, 0);
+	}
+}
+
+static inline void portIrqEnable(void) {
+	portIrqRestore(0);
+}
+
+#endif /* PORT_HOST_H_ */
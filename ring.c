@@ -0,0 +1,164 @@
+/*
+ * ring.c
+ *
+ * Created: 10/16/2026 9:52:03 PM
+ *  Author: Alex Ionita
+ */ 
+#include <string.h>
+
+#include "ring.h"
+
+#if TASK_RING
+
+// Keeps the compiler from moving element copies past the index update
+// that hands them to the other side.
+#define RING_BARRIER() __asm__ __volatile__("" ::: "memory")
+
+uint8_t ringInit(Ring *r, void *buffer, uint8_t elementSize, uint8_t count) {
+	// The indices wrap at 256, which has to be a multiple of the capacity
+	// and leave room to tell a full ring from an empty one.
+	if (count < 2 || count > 128 || (count & (count - 1))) {
+		return 0;
+	}
+
+	r->buffer = buffer;
+	r->head = 0;
+	r->tail = 0;
+	r->mask = count - 1;
+	r->elementSize = elementSize;
+	#if TASK_NOTIFY
+	r->consumer = 0;
+	#endif
+
+	return 1;
+}
+
+uint8_t ringCount(Ring *r) {
+	return r->head - r->tail;
+}
+
+uint8_t ringSpace(Ring *r) {
+	return r->mask + 1 - (uint8_t)(r->head - r->tail);
+}
+
+// Called by the producer after moving head.
+static void ringWritten(Ring *r) {
+	#if TASK_NOTIFY
+	if (r->consumer && (uint8_t)(r->head - r->tail) >= r->threshold) {
+		taskNotifyFromISR(r->consumer, r->bits, TASK_NOTIFY_BITS);
+	}
+	#endif
+}
+
+// Copy n elements between data and the ring starting at element index,
+// in two pieces if they wrap.
+static void ringCopy(Ring *r, uint8_t index, void *data, uint8_t n, uint8_t in) {
+	uint8_t first = r->mask + 1 - (index & r->mask);
+	uint16_t offset = (uint16_t)(index & r->mask) * r->elementSize;
+	uint16_t size;
+
+	if (first > n) {
+		first = n;
+	}
+
+	size = (uint16_t)first * r->elementSize;
+	if (in) {
+		memcpy(r->buffer + offset, data, size);
+	} else {
+		memcpy(data, r->buffer + offset, size);
+	}
+
+	if (first < n) {
+		data = (uint8_t *)data + size;
+		size = (uint16_t)(n - first) * r->elementSize;
+		if (in) {
+			memcpy(r->buffer, data, size);
+		} else {
+			memcpy(data, r->buffer, size);
+		}
+	}
+}
+
+uint8_t ringWrite(Ring *r, const void *data, uint8_t n) {
+	uint8_t head = r->head;
+	uint8_t space = r->mask + 1 - (uint8_t)(head - r->tail);
+
+	if (n > space) {
+		n = space;
+	}
+
+	if (n) {
+		ringCopy(r, head, (void *)data, n, 1);
+		RING_BARRIER();
+		head += n;
+		r->head = head;
+		ringWritten(r);
+	}
+
+	return n;
+}
+
+uint8_t ringRead(Ring *r, void *data, uint8_t n) {
+	uint8_t tail = r->tail;
+	uint8_t count = r->head - tail;
+
+	if (n > count) {
+		n = count;
+	}
+
+	if (n) {
+		RING_BARRIER();
+		ringCopy(r, tail, data, n, 0);
+		RING_BARRIER();
+		r->tail = tail + n;
+	}
+
+	return n;
+}
+
+uint8_t ringPut(Ring *r, uint8_t c) {
+	uint8_t head = r->head;
+
+	if ((uint8_t)(head - r->tail) > r->mask) {
+		return 0;
+	}
+
+	r->buffer[head & r->mask] = c;
+	RING_BARRIER();
+	r->head = head + 1;
+	ringWritten(r);
+
+	return 1;
+}
+
+uint8_t ringGet(Ring *r, uint8_t *c) {
+	uint8_t tail = r->tail;
+
+	if (r->head == tail) {
+		return 0;
+	}
+
+	RING_BARRIER();
+	*c = r->buffer[tail & r->mask];
+	RING_BARRIER();
+	r->tail = tail + 1;
+
+	return 1;
+}
+
+#if TASK_NOTIFY
+void ringNotify(Ring *r, Task *t, uint8_t threshold, uint16_t bits) {
+	PortIrqState irq;
+
+	// The producer may be an ISR halfway through reading these.
+	irq = portIrqSave();
+
+	r->consumer = t;
+	r->threshold = threshold;
+	r->bits = bits;
+
+	portIrqRestore(irq);
+}
+#endif
+
+#endif // TASK_RING
@@ -0,0 +1,75 @@
+/*
+ * ring.h
+ *
+ * Created: 10/16/2026 9:47:16 PM
+ *  Author: Alex Ionita
+ */ 
+
+
+#ifndef RING_H_
+#define RING_H_
+
+#include <stdint.h>
+
+#include "task.h"
+
+// Ring buffer for one producer and one consumer, typically an ISR feeding
+// a task. Neither side disables interrupts: the producer only moves head,
+// the consumer only moves tail, and both are single bytes. Elements are
+// elementSize bytes, the byte functions are for rings of single bytes.
+//
+//   static RING_BUFFER(rxBuffer, 1, 64);
+//   static Ring rx;
+//   ringInit(&rx, rxBuffer, 1, 64);
+//
+// Any more producers or consumers need a lock around their side.
+
+// Declare the storage for count elements of size bytes.
+#define RING_BUFFER(name, size, count) uint8_t name[(uint16_t)(size) * (count)]
+
+typedef struct {
+	uint8_t *buffer;
+	volatile uint8_t head; // Elements written, wraps.
+	volatile uint8_t tail; // Elements read, wraps.
+	uint8_t mask; // Capacity - 1.
+	uint8_t elementSize;
+	#if TASK_NOTIFY
+	Task *consumer; // Notified by the producer, 0 for none.
+	uint16_t bits;
+	uint8_t threshold;
+	#endif
+} Ring;
+
+// count is a power of two from 2 to 128. Returns 0 and leaves r alone
+// for any other count.
+uint8_t ringInit(Ring *r, void *buffer, uint8_t elementSize, uint8_t count);
+
+// Elements queued, as seen from either side.
+uint8_t ringCount(Ring *r);
+
+// Elements that still fit.
+uint8_t ringSpace(Ring *r);
+
+// Copy up to n elements in, returns how many fitted. Producer side.
+uint8_t ringWrite(Ring *r, const void *data, uint8_t n);
+
+// Copy up to n elements out, returns how many there were. Consumer side.
+uint8_t ringRead(Ring *r, void *data, uint8_t n);
+
+// Returns 0 when the ring is full.
+uint8_t ringPut(Ring *r, uint8_t c);
+
+// Returns 0 when the ring is empty.
+uint8_t ringGet(Ring *r, uint8_t *c);
+
+#if TASK_NOTIFY
+// From now on every write leaving threshold or more elements queued does
+// taskNotifyFromISR(t, bits, TASK_NOTIFY_BITS), t = 0 turns that off. The
+// consumer waits with taskNotifyWait() and then reads what is there, which
+// can be less than threshold after a read raced with a write. A producer
+// ISR ends with taskPreempt(), a producer task with taskYield() if the
+// consumer should run at once.
+void ringNotify(Ring *r, Task *t, uint8_t threshold, uint16_t bits);
+#endif
+
+#endif /* RING_H_ */
@@ -0,0 +1,90 @@
+/*
+ * semaphore.c
+ *
+ * Created: 10/16/2026 9:13:05 AM
+ *  Author: Alex Ionita
+ */ 
+
+#include "semaphore.h"
+
+#include "task.h"
+
+#if TASK_SEMAPHORE
+
+void semaphoreInit(Semaphore *s, uint16_t count) {
+	s->count = count;
+	QUEUE_INIT(&s->waiting);
+}
+
+void semaphoreTake(Semaphore *s) {
+	PortIrqState irq;
+
+	irq = portIrqSave();
+
+	if (s->count) {
+		s->count--;
+	} else {
+		// semaphoreGive() hands its unit straight to us.
+		taskSuspendPrio(&s->waiting);
+	}
+
+	portIrqRestore(irq);
+}
+
+uint8_t semaphoreTakeTimeout(Semaphore *s, uint16_t ms) {
+	PortIrqState irq;
+	uint8_t result = SEMAPHORE_OK;
+
+	irq = portIrqSave();
+
+	if (s->count) {
+		s->count--;
+	} else if (ms == 0 || taskSuspendTimeout(&s->waiting, ms)) {
+		result = SEMAPHORE_TIMEOUT;
+	}
+
+	portIrqRestore(irq);
+
+	return result;
+}
+
+// Count a unit in, or return the highest priority waiter to hand it to.
+static Task *semaphoreRelease(Semaphore *s) {
+	if (QUEUE_EMPTY(&s->waiting)) {
+		s->count++;
+		return 0;
+	}
+
+	return QUEUE_DATA(QUEUE_HEAD(&s->waiting), Task, member);
+}
+
+void semaphoreGive(Semaphore *s) {
+	PortIrqState irq;
+	Task *t;
+
+	irq = portIrqSave();
+
+	t = semaphoreRelease(s);
+	if (t) {
+		taskWakeup(t);
+	}
+
+	portIrqRestore(irq);
+}
+
+void semaphoreGiveFromISR(Semaphore *s) {
+	PortIrqState irq;
+	Task *t;
+
+	// Handlers may run with interrupts enabled, see TASK_ISR.
+	irq = portIrqSave();
+
+	t = semaphoreRelease(s);
+	if (t) {
+		taskWakeupFromISR(t);
+	}
+
+	portIrqRestore(irq);
+}
+
+#endif // TASK_SEMAPHORE
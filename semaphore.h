@@ -0,0 +1,41 @@
+/*
+ * semaphore.h
+ *
+ * Created: 10/16/2026 9:12:40 AM
+ *  Author: Alex Ionita
+ */ 
+
+
+#ifndef SEMAPHORE_H_
+#define SEMAPHORE_H_
+
+#include <stdint.h>
+
+#include "queue.h"
+
+// Results of semaphoreTakeTimeout().
+#define SEMAPHORE_OK 0
+#define SEMAPHORE_TIMEOUT 1
+
+typedef struct SemaphoreStruct Semaphore;
+
+struct SemaphoreStruct {
+	uint16_t count;
+	QUEUE waiting; // Waiters, highest priority first.
+};
+
+void semaphoreInit(Semaphore *s, uint16_t count);
+
+void semaphoreTake(Semaphore *s);
+
+// Wait at most ms milliseconds, 0 does not wait at all.
+uint8_t semaphoreTakeTimeout(Semaphore *s, uint16_t ms);
+
+void semaphoreGive(Semaphore *s);
+
+// Give from an interrupt. End the ISR with taskPreempt().
+void semaphoreGiveFromISR(Semaphore *s);
+
+
+
+#endif /* SEMAPHORE_H_ */
\ No newline at end of file
@@ -4,16 +4,33 @@
  * Created: 1/8/2019 7:38:36 PM
  *  Author: Alex Ionita
  */ 
-#include <avr/interrupt.h>
-#include <avr/io.h>
+#include <string.h>
 
-#include "task.h"
+#include "pool.h"
+#include "port.h"
+#include "trace.h"
 
 
-static Task *currentTask = 0;
+Task *currentTask = 0;
 
+#if TASK_SCHED_EDF
+// Ready tasks, earliest deadline first, then those without a deadline.
+static QUEUE readyByDeadline;
 
-static QUEUE readyTasks;
+// Sum of wcet / min(deadline, period) over the tasks admitted, 1 is 0x10000.
+static uint32_t taskUtilization;
+#else
+// One round-robin queue per priority level.
+static QUEUE readyTasks[TASK_PRIORITIES];
+
+// Bit n is set while readyTasks[n] is not empty.
+static uint8_t readyMask;
+
+// Index of the highest set bit of a nibble.
+static const uint8_t taskHighestBit[16] PROGMEM = {
+	0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3
+};
+#endif
 
 
 static QUEUE suspendedTasks;
@@ -21,6 +38,54 @@ static QUEUE suspendedTasks;
 
 static QUEUE sleepingTasks;
 
+
+// Memory for all task stacks and TCBs. The top TASK_SCHEDULER_STACK bytes
+// are the scheduler's stack, tasks are carved downward below it.
+static uint8_t taskArena[TASK_ARENA_SIZE] __attribute__((aligned(PORT_ALIGN)));
+
+static uint8_t *taskArenaTop = taskArena + TASK_ARENA_SIZE - TASK_SCHEDULER_STACK;
+
+// Tasks created so far, the last id handed out.
+static uint8_t taskCount;
+
+// Last task created, all others are reached through Task.older.
+static Task *taskNewest;
+
+// Ticks since taskInit().
+static TASK_TICK_T taskTicks;
+
+#if TASK_NOTIFY
+// Task.notify flags.
+#define TASK_NOTIFY_PENDING 0x01
+#define TASK_NOTIFY_WAITING 0x02
+#endif
+
+#if TASK_QUANTUM
+// Ticks left of the running task's time slice.
+static uint8_t taskSlice;
+#endif
+
+uint8_t *const taskSchedulerStack = taskArena + TASK_ARENA_SIZE;
+
+// Lowest byte of the scheduler stack.
+#define TASK_SCHEDULER_BOTTOM (taskSchedulerStack - TASK_SCHEDULER_STACK)
+
+// Round n up to a multiple of PORT_ALIGN.
+#define TASK_ALIGN(n) (((n) + PORT_ALIGN - 1) & ~(PORT_ALIGN - 1))
+
+#if TASK_POOL_TASKS
+#if !TASK_POOL
+#error "TASK_POOL_TASKS needs TASK_POOL"
+#endif
+
+// A stack of TASK_STACK_DEFAULT bytes with its TCB on top, like in the arena.
+#define TASK_SLOT_SIZE (TASK_ALIGN((size_t)TASK_STACK_DEFAULT) + TASK_ALIGN(sizeof(Task)))
+
+static POOL_BUFFER(taskSlots, TASK_SLOT_SIZE, TASK_POOL_TASKS);
+
+static Pool taskPool;
+#endif
+
 #if TASK_COUNT_SEC
 static TASK_SEC_T _task_sec = 0;
 
@@ -32,12 +97,12 @@ TASK_SEC_T taskAddSecond(void) {
 }
 
 void taskSetSecond(TASK_SEC_T t) {
-	uint8_t sreg = SREG;
+	PortIrqState irq;
 
-	cli();
+	irq = portIrqSave();
 	_task_sec = t;
 	_task_sec_countdown = 1000 / MS_PER_TICK;
-	SREG = sreg;
+	portIrqRestore(irq);
 }
 #endif // TASK_COUNT_SEC
 
@@ -49,11 +114,11 @@ TASK_MSEC_T taskAddMilisecond(void) {
 }
 
 void taskSetMilisecond(TASK_MSEC_T t) {
-	uint8_t sreg = SREG;
+	PortIrqState irq;
 
-	cli();
+	irq = portIrqSave();
 	_task_msec = t;
-	SREG = sreg;
+	portIrqRestore(irq);
 }
 #endif // TASK_COUNT_MSEC
 
@@ -61,368 +126,655 @@ void taskSetMilisecond(TASK_MSEC_T t) {
 static TASK_USEC_T _task_usec = 0;
 
 TASK_USEC_T taskAddMicrosecond(void) {
-	return (_task_usec + (TCNT0 * US_PER_COUNT));
+	return (_task_usec + (portTimerCount() * US_PER_COUNT));
 }
 
 void taskSetMicrosecond(TASK_USEC_T t) {
-	uint8_t sreg = SREG;
+	PortIrqState irq;
 
-	cli();
+	irq = portIrqSave();
 	_task_usec = t;
-	SREG = sreg;
+	portIrqRestore(irq);
 }
 #endif // TASK_COUNT_USEC
 
-// Push a task's context onto its own stack.
-static inline void taskPush(void) __attribute__ ((always_inline));
-static inline void taskPush(void) {
-	asm volatile(
-	"push r0\n"
-	// Save status register
-	"in r0, 0x3f\n"
-	"cli\n"
-	"push r0\n"
-	// Save Z register pair (so it can be used below)
-	"push r30\n"
-	"push r31\n"
-	// Load currentTask into Z register pair
-	"lds r30, currentTask\n" // Low
-	"lds r31, currentTask+1\n" // High
-	// Z=1 if (r30 | r31) == 0
-	"mov r0, r30\n"
-	"or r0, r31\n"
-	// Save if Z=0 (currentTask != NULL)
-	"brne 2f\n"
-	"1:\n"
-	// Restore Z register pair
-	"pop r31\n"
-	"pop r30\n"
-	// Restore status register and real r0
-	"pop r0\n"
-	"out 0x3f, r0\n"
-	"pop r0\n"
-	"rjmp 3f\n"
-	"2:\n"
-	// Save general registers
-	"push r1\n"
-	"push r2\n"
-	"push r3\n"
-	"push r4\n"
-	"push r5\n"
-	"push r6\n"
-	"push r7\n"
-	"push r8\n"
-	"push r9\n"
-	"push r10\n"
-	"push r11\n"
-	"push r12\n"
-	"push r13\n"
-	"push r14\n"
-	"push r15\n"
-	"push r16\n"
-	"push r17\n"
-	"push r18\n"
-	"push r19\n"
-	"push r20\n"
-	"push r21\n"
-	"push r22\n"
-	"push r23\n"
-	"push r24\n"
-	"push r25\n"
-	"push r26\n"
-	"push r27\n"
-	"push r28\n"
-	"push r29\n"
-	// Compiler expects r1 to be zero. As this code may interrupt anything,
-	// the register may temporarily hold a non-zero value.
-	"clr r1\n"
-	// Save stack pointer in current task struct
-	"in r0, 0x3d\n" // Low
-	"st z+, r0\n"
-	"in r0, 0x3e\n" // High
-	"st z+, r0\n"
-	"3:\n"
-	);
-}
-
-// Pop a task's context off of its own stack and resume it.
-static void taskPop(void) __attribute__ ((naked));
-static void taskPop(void) {
-	asm volatile(
-	// Restore stack pointer from current task struct
-	"lds r26, currentTask\n" // Low
-	"lds r27, currentTask+1\n" // High
-	"ld r0, x+\n"
-	"out 0x3d, r0\n" // Low
-	"ld r0, x+\n"
-	"out 0x3e, r0\n" // High
-	// Restore general registers
-	"pop r29\n"
-	"pop r28\n"
-	"pop r27\n"
-	"pop r26\n"
-	"pop r25\n"
-	"pop r24\n"
-	"pop r23\n"
-	"pop r22\n"
-	"pop r21\n"
-	"pop r20\n"
-	"pop r19\n"
-	"pop r18\n"
-	"pop r17\n"
-	"pop r16\n"
-	"pop r15\n"
-	"pop r14\n"
-	"pop r13\n"
-	"pop r12\n"
-	"pop r11\n"
-	"pop r10\n"
-	"pop r9\n"
-	"pop r8\n"
-	"pop r7\n"
-	"pop r6\n"
-	"pop r5\n"
-	"pop r4\n"
-	"pop r3\n"
-	"pop r2\n"
-	"pop r1\n"
-	// Restore Z register pair
-	"pop r31\n"
-	"pop r30\n"
-
-	// Restore status register.
-
-	"pop r0\n"
-	"sbrs r0, 7\n" // Skip if bit in register set
-	"jmp task_pop_ret\n"
-	"jmp task_pop_reti\n"
-	"task_pop_ret:\n"
-	"out 0x3f, r0\n" // Restore status register
-	"pop r0\n" // Restore the real r0
-	"ret\n"
-	"task_pop_reti:\n"
-	"clt\n" // Clear T in SREG
-	"bld r0, 7\n" // Bit load from T to r0 bit 7 (interrupt bit)
-	"out 0x3f, r0\n" // Restore status register (without interrupt bit set)
-	"pop r0\n" // Restore the real r0
-	"reti\n"
-	);
-}
-
-
-static void *taskInitializeInternal(void *sp, TaskFunction fn, void *data) {
-	void *result;
-
-	asm volatile(
-	// About to overwrite the stack pointer, disable interrupts
-	"in r18, 0x3f\n" // r18 can be clobbered
-	"cli\n"
-	// Save current stack pointer
-	"in r26, 0x3d\n"
-	"in r27, 0x3e\n"
-	// Set new task's stack pointer
-	"out 0x3d, %A1\n"
-	"out 0x3e, %B1\n"
-	// Store location of task body as return address, such that
-	// executing "ret" after "context_restore" will jump to it.
-	"push %A2\n"
-	"push %B2\n"
-	#ifdef __AVR_3_BYTE_PC__
-	// Push extra zero, assuming the task function is not located
-	// in high program memory (>128KiB).
-	"clr __tmp_reg__\n"
-	"push __tmp_reg__\n"
-	#endif
-	// Store r0
-	"ldi r19, 0\n" // r19 can be clobbered
-	"push r19\n"
-	// Store status register
-	"ldi r19, 0x80\n" // Start task with interrupts enabled
-	"push r19\n"
-	// Store general registers
-	"ldi r19, 0\n"
-	"push r19\n" // r30
-	"push r19\n" // r31
-	"push r19\n" // r1
-	"push r19\n" // r2
-	"push r19\n" // r3
-	"push r19\n" // r4
-	"push r19\n" // r5
-	"push r19\n" // r6
-	"push r19\n" // r7
-	"push r19\n" // r8
-	"push r19\n" // r9
-	"push r19\n" // r10
-	"push r19\n" // r11
-	"push r19\n" // r12
-	"push r19\n" // r13
-	"push r19\n" // r14
-	"push r19\n" // r15
-	"push r19\n" // r16
-	"push r19\n" // r17
-	"push r19\n" // r18
-	"push r19\n" // r19
-	"push r19\n" // r20
-	"push r19\n" // r21
-	"push r19\n" // r22
-	"push r19\n" // r23
-	// Argument to task function
-	"push %A3\n" // r24
-	"push %B3\n" // r25
-	"push r19\n" // r26
-	"push r19\n" // r27
-	"push r19\n" // r28
-	"push r19\n" // r29
-	// Store new task's stack pointer at return register
-	"in %A0, 0x3d\n"
-	"in %B0, 0x3e\n"
-	// Restore stack pointer
-	"out 0x3d, r26\n"
-	"out 0x3e, r27\n"
-	// Restore status register
-	"out 0x3f, r18\n"
-	: "=r" (result)
-	: "r" (sp), "r" (fn), "r" (data)
-	: "r18", "r19", "r26", "r27"
-	);
+// Take a TCB and a stack of stackSize bytes from the task pool, or carve
+// them from the arena, TCB on top.
+static Task *taskAllocate(uint16_t stackSize) {
+	PortIrqState irq;
+	size_t size = TASK_ALIGN((size_t)stackSize);
+	uint8_t *bottom = 0;
+	Task *t;
 
-	return result;
-}
+	irq = portIrqSave();
 
+	#if TASK_POOL_TASKS
+	if (stackSize == TASK_STACK_DEFAULT) {
+		bottom = poolAlloc(&taskPool);
+	}
+	#endif
 
-Task *taskCreateInternal(TaskFunction fn, void *data) {
-	static void *start = (void *)RAMEND;
-	void *sp;
-	Task *t;
+	if (bottom == 0) {
+		if ((size_t)(taskArenaTop - taskArena) < size + TASK_ALIGN(sizeof(Task))) {
+			portIrqRestore(irq);
+			return 0;
+		}
 
+		taskArenaTop -= size + TASK_ALIGN(sizeof(Task));
+		bottom = taskArenaTop;
+	}
 
-	start -= 0x100;
+	t = (Task *)(bottom + size);
+	t->id = ++taskCount;
+	t->older = taskNewest;
+	taskNewest = t;
 
+	portIrqRestore(irq);
 
-	t = start - sizeof(Task);
-	sp = (void *)t - 1;
+	// Paint the stack so taskStackHighWater() can tell what was used.
+	t->stackBottom = bottom;
+	memset(t->stackBottom, TASK_STACK_PAINT, size);
 
-	t->stackPointer = taskInitializeInternal(sp, fn, data);
 	t->delay = 0;
+	t->mutexes = 0;
+	t->overruns = 0;
+	#if TASK_SCHED_EDF
+	t->utilization = 0;
+	t->relDeadline = 0;
+	t->hasDeadline = 0;
+	t->deadline = 0;
+	t->baseDeadline = 0;
+	#endif
+	#if TASK_CPU_STATS
+	t->cpu = 0;
+	#endif
+	#if TASK_COROUTINES
+	t->co = 0;
+	#endif
+	#if TASK_NOTIFY
+	t->notifyValue = 0;
+	t->notify = 0;
+	#endif
 	QUEUE_INIT(&t->member);
+	QUEUE_INIT(&t->timer);
+
+	return t;
+}
+
+Task *taskCreateInternal(TaskFunction fn, void *data, uint16_t stackSize) {
+	Task *t;
+
+	if (stackSize < TASK_STACK_MIN) {
+		return 0;
+	}
+
+	t = taskAllocate(stackSize);
+	if (t) {
+		portTaskInit(t, fn, data);
+	}
+
+	return t;
+}
+
+// Give back the memory of a deleted task. Arena memory only comes back
+// when t was the last task carved from it.
+static void taskFree(Task *t) {
+	#if TASK_POOL_TASKS
+	if (t->stackBottom >= taskSlots && t->stackBottom < taskSlots + sizeof(taskSlots)) {
+		poolFree(&taskPool, t->stackBottom);
+		return;
+	}
+	#endif
+
+	if (t->stackBottom == taskArenaTop) {
+		taskArenaTop = (uint8_t *)t + TASK_ALIGN(sizeof(Task));
+	}
+}
+
+
+// Nonzero when a is to run before b.
+static uint8_t taskOutranks(Task *a, Task *b) {
+	#if TASK_SCHED_EDF
+	if (!a->hasDeadline) {
+		return 0;
+	}
+
+	if (!b->hasDeadline) {
+		return 1;
+	}
+
+	return TASK_TICK_BEFORE(a->deadline, b->deadline);
+	#else
+	return a->priority > b->priority;
+	#endif
+}
+
+#if TASK_SCHED_EDF
+static void taskReadyInsert(Task *t) {
+	QUEUE *q;
+
+	// Behind the tasks due at the same time or earlier.
+	QUEUE_FOREACH(q, &readyByDeadline) {
+		if (taskOutranks(t, QUEUE_DATA(q, Task, member))) {
+			break;
+		}
+	}
+
+	QUEUE_INSERT_TAIL(q, &t->member);
+	t->state = TASK_STATE_READY;
+}
+
+static void taskReadyRemove(Task *t) {
+	QUEUE_REMOVE(&t->member);
+}
+
+// Change the effective deadline, moving t in the ready queue if needed.
+static void taskSetDeadline(Task *t, TASK_TICK_T deadline, uint8_t hasDeadline) {
+	t->deadline = deadline;
+	t->hasDeadline = hasDeadline;
+
+	if (t->state == TASK_STATE_READY) {
+		taskReadyRemove(t);
+		taskReadyInsert(t);
+	}
+}
+
+// Start a new job of t, released at tick release. An inherited deadline
+// is kept while it is earlier than the job's own one.
+static void taskRelease(Task *t, TASK_TICK_T release) {
+	TASK_TICK_T d = release + t->relDeadline;
+
+	if (t->deadline == t->baseDeadline || TASK_TICK_BEFORE(d, t->deadline)) {
+		t->deadline = d;
+	}
+
+	t->baseDeadline = d;
+}
+#else
+// Highest priority level with a ready task. readyMask must not be zero.
+static uint8_t taskHighestPriority(void) {
+	if (readyMask & 0xF0) {
+		return 4 + pgm_read_byte(&taskHighestBit[readyMask >> 4]);
+	}
+
+	return pgm_read_byte(&taskHighestBit[readyMask]);
+}
+
+static void taskReadyInsert(Task *t) {
+	QUEUE_INSERT_TAIL(&readyTasks[t->priority], &t->member);
+	readyMask |= _BV(t->priority);
+	t->state = TASK_STATE_READY;
+}
+
+static void taskReadyRemove(Task *t) {
+	QUEUE_REMOVE(&t->member);
+
+	if (QUEUE_EMPTY(&readyTasks[t->priority])) {
+		readyMask &= ~_BV(t->priority);
+	}
+}
+#endif
+
+#if TASK_COROUTINES
+// A coroutine runs on the scheduler stack until its next wait, switching
+// away in the middle would lose its C frame.
+#define TASK_PREEMPTIBLE(t) ((t)->co == 0)
+#else
+#define TASK_PREEMPTIBLE(t) 1
+#endif
+
+// A ready task outranks the running one.
+static uint8_t taskOutranked(void) {
+	#if TASK_SCHED_EDF
+	return taskOutranks(QUEUE_DATA(QUEUE_HEAD(&readyByDeadline), Task, member), currentTask);
+	#else
+	return (readyMask >> currentTask->priority) > 1;
+	#endif
+}
+
+#if TASK_QUANTUM
+// Another ready task ranks the same as the running one.
+static uint8_t taskHasPeer(void) {
+	#if TASK_SCHED_EDF
+	QUEUE *n = QUEUE_NEXT(&currentTask->member);
+
+	return n != &readyByDeadline && !taskOutranks(currentTask, QUEUE_DATA(n, Task, member));
+	#else
+	QUEUE *h = &readyTasks[currentTask->priority];
+
+	return QUEUE_NEXT(h) != QUEUE_PREV(h);
+	#endif
+}
+#endif
+
+// Whether the running task has to be switched out after ticks more ticks:
+// a task that outranks it is ready, or its time slice is used up and a
+// task of the same rank is waiting for its turn.
+static uint8_t taskTickSwitch(uint16_t ticks) {
+	if (currentTask == 0 || !TASK_PREEMPTIBLE(currentTask)) {
+		return 0;
+	}
+
+	if (taskOutranked()) {
+		return 1;
+	}
+
+	#if TASK_QUANTUM
+	taskSlice = ticks < taskSlice ? taskSlice - ticks : 0;
+
+	return taskSlice == 0 && taskHasPeer();
+	#else
+	return 0;
+	#endif
+}
+
+// Take task off sleepingTasks, giving its remaining delay to the next one.
+static void taskTimerCancel(Task *t) {
+	QUEUE *n;
+
+	if (QUEUE_EMPTY(&t->timer)) {
+		return;
+	}
+
+	n = QUEUE_NEXT(&t->timer);
+	if (n != &sleepingTasks) {
+		QUEUE_DATA(n, Task, timer)->delay += t->delay;
+	}
+
+	QUEUE_REMOVE(&t->timer);
+	QUEUE_INIT(&t->timer);
+}
+
+// Move task to its ready queue without switching to it. Whichever of its
+// wait queue and sleep timer did not wake it is cancelled.
+static void taskReady(Task *t) {
+	TRACE_TASK(TRACE_WAKEUP, t);
+	taskTimerCancel(t);
+	QUEUE_REMOVE(&t->member);
+	taskReadyInsert(t);
+}
+
+// Give a new task its priority and make it ready, t may be 0. Like
+// taskWakeup(), switch to it at once if it outranks the calling task.
+static Task *taskAdmit(Task *t, uint8_t priority) {
+	PortIrqState irq;
+
+	if (t == 0) {
+		return 0;
+	}
+
+	if (priority >= TASK_PRIORITIES) {
+		priority = TASK_PRIORITIES - 1;
+	}
+
+	t->priority = priority;
+	t->basePriority = priority;
+
+	irq = portIrqSave();
+	taskReadyInsert(t);
+	taskPreempt();
+	portIrqRestore(irq);
 
 	return t;
 }
 
+static Task *taskCreateReady(TaskFunction fn, void *data, uint16_t stackSize, uint8_t priority) {
+	return taskAdmit(taskCreateInternal(fn, data, stackSize), priority);
+}
+
+#if TASK_COROUTINES
+Task *taskCreateCoroutine(TaskCoroutine fn, void *data, uint8_t priority) {
+	Task *t = taskAllocate(0);
+
+	if (t) {
+		t->co = fn;
+		t->coData = data;
+		t->line = 0;
+	}
+
+	return taskAdmit(t, priority);
+}
+#endif
+
+Task *taskCreatePrio(TaskFunction fn, void *data, uint8_t priority) {
+	return taskCreateReady(fn, data, TASK_STACK_DEFAULT, priority);
+}
+
+Task *taskCreateEx(TaskFunction fn, void *data, uint16_t stackSize) {
+	return taskCreateReady(fn, data, stackSize, TASK_PRIORITY_DEFAULT);
+}
 
 Task *taskCreate(TaskFunction fn, void *data) {
-	Task *t = taskCreateInternal(fn, data);
+	return taskCreateReady(fn, data, TASK_STACK_DEFAULT, TASK_PRIORITY_DEFAULT);
+}
+
+#if TASK_SCHED_EDF
+Task *taskCreateDeadline(TaskFunction fn, void *data, uint16_t stackSize, uint16_t wcet, uint16_t period, uint16_t deadline) {
+	PortIrqState irq;
+	uint32_t u;
+	Task *t;
+
+	if (deadline == 0) {
+		deadline = period;
+	}
+
+	if (period == 0) {
+		return 0;
+	}
 
-	QUEUE_INSERT_TAIL(&readyTasks, &t->member);
+	// Density test, sufficient for EDF on one CPU with deadlines up to the
+	// period, exact when they equal it.
+	u = ((uint32_t)wcet << 16) / (deadline < period ? deadline : period);
+
+	irq = portIrqSave();
+
+	// taskUtilization never exceeds 1, the sum could wrap for a huge u.
+	if (u > 0x10000UL - taskUtilization) {
+		portIrqRestore(irq);
+		return 0;
+	}
+
+	t = taskCreateReady(fn, data, stackSize, TASK_PRIORITY_DEFAULT);
+
+	if (t) {
+		taskUtilization += u;
+		t->utilization = u;
+		t->relDeadline = deadline;
+		t->baseDeadline = taskTicks + deadline;
+		taskSetDeadline(t, t->baseDeadline, 1);
+		taskPreempt();
+	}
+
+	portIrqRestore(irq);
 
 	return t;
 }
+#endif
 
-static void taskTick() {
-	QUEUE *q, *r;
+uint8_t taskAdvance(uint16_t ticks) {
+	uint16_t left = ticks;
+	uint16_t d;
+	QUEUE *q;
 	Task *t;
 
 	#if TASK_COUNT_SEC
-	if (--_task_sec_countdown == 0) {
+	uint16_t n = ticks;
+
+	while (n >= _task_sec_countdown) {
+		n -= _task_sec_countdown;
 		_task_sec++;
 		_task_sec_countdown = 1000 / MS_PER_TICK;
 	}
+	_task_sec_countdown -= n;
 	#endif
 
 	#if TASK_COUNT_MSEC
-	_task_msec += MS_PER_TICK;
+	_task_msec += ticks * MS_PER_TICK;
 	#endif
 
 	#if TASK_COUNT_USEC
-	_task_usec += US_PER_TICK;
+	_task_usec += ticks * US_PER_TICK;
+	#endif
+
+	taskTicks += ticks;
+
+	#if TASK_TRACE
+	traceTicks += ticks;
 	#endif
+	TRACE_TASK(TRACE_TICK, currentTask);
 
-	q = QUEUE_NEXT(&sleepingTasks);
-	r = 0;
-	for (; q != &sleepingTasks; q = r) {
+	// Delays are stored relative to the previous sleeper, so the ticks are
+	// counted off the head and only what it leaves carries on to the next.
+	// Late ones, more ticks than the head had left, expire at once.
+	q = QUEUE_HEAD(&sleepingTasks);
+	while (q != &sleepingTasks) {
+		t = QUEUE_DATA(q, Task, timer);
 
-		r = QUEUE_NEXT(q);
-		t = QUEUE_DATA(q, Task, member);
+		d = t->delay < left ? t->delay : left;
+		t->delay -= d;
+		left -= d;
 
 		if (t->delay) {
-			t->delay--;
+			break;
 		}
 
-		if (t->delay == 0) {
-			taskWakeup(t);
+		q = QUEUE_NEXT(q);
+
+		// A blocked task here was in a timed wait that ran out.
+		if (t->state == TASK_STATE_BLOCKED) {
+			t->timeout = 1;
+		}
+		#if TASK_SCHED_EDF
+		// Waking from a sleep starts a new job.
+		else if (t->relDeadline) {
+			taskRelease(t, taskTicks);
 		}
+		#endif
+
+		taskReady(t);
 	}
+
+	return taskTickSwitch(ticks);
 }
 
-static void taskScheduler(void) {
+uint16_t taskNextWakeup(void) {
+	if (QUEUE_EMPTY(&sleepingTasks)) {
+		return 0;
+	}
 
-	asm volatile(
-	"out 0x3d, %A0\n"
-	"out 0x3e, %B0\n"
-	:: "x" (RAMEND)
-	);
+	return QUEUE_DATA(QUEUE_HEAD(&sleepingTasks), Task, timer)->delay;
+}
 
-	for (;;) {
-		QUEUE *q;
+#if TASK_CPU_STATS
+static uint32_t taskCpuIdle;
 
-		currentTask = 0;
+// Time of the last sample.
+static uint32_t taskCpuStamp;
 
+// Timer counts since taskInit(). Interrupts must be disabled.
+static uint32_t taskCpuNow(void) {
+	uint32_t ticks = taskTicks;
+	uint8_t count = portTimerCount();
 
-		QUEUE_FOREACH(q, &readyTasks) {
+	// The counter wrapped but the tick has not been counted yet.
+	if (portTimerPending() && count < COUNTS_PER_TICK / 2) {
+		ticks++;
+	}
 
-			currentTask = QUEUE_DATA(q, Task, member);
+	return ticks * COUNTS_PER_TICK + count;
+}
 
-			QUEUE_ROTATE(&readyTasks, q);
+// Charge the time since the last sample to t, or to idle when t is 0.
+static void taskCpuCharge(Task *t) {
+	uint32_t now = taskCpuNow();
 
+	if (t) {
+		t->cpu += now - taskCpuStamp;
+	} else {
+		taskCpuIdle += now - taskCpuStamp;
+	}
+
+	taskCpuStamp = now;
+}
+
+uint32_t taskCpuTime(Task *t) {
+	PortIrqState irq;
+	uint32_t time;
+
+	irq = portIrqSave();
+
+	taskCpuCharge(currentTask);
+	time = t ? t->cpu : taskCpuIdle;
+
+	portIrqRestore(irq);
+
+	return time;
+}
+
+uint8_t taskCpuSnapshot(TaskCpuStat *stats, uint8_t n, uint8_t reset) {
+	PortIrqState irq;
+	uint8_t i = 0;
+	Task *t;
 
-			taskPop();
+	irq = portIrqSave();
+
+	taskCpuCharge(currentTask);
+
+	if (n) {
+		stats[i].task = 0;
+		stats[i].time = taskCpuIdle;
+		i++;
+	}
+
+	for (t = taskNewest; t; t = t->older) {
+		if (i < n) {
+			stats[i].task = t;
+			stats[i].time = t->cpu;
+			i++;
 		}
 
+		if (reset) {
+			t->cpu = 0;
+		}
+	}
 
-		sei();
-		asm volatile ("sleep");
-		cli();
+	if (reset) {
+		taskCpuIdle = 0;
 	}
+
+	portIrqRestore(irq);
+
+	return i;
 }
+#endif // TASK_CPU_STATS
 
-static void taskJmpScheduler(void) {
-	asm volatile ("ijmp" :: "z" (taskScheduler));
+#if TASK_STACK_CHECK
+static void taskSchedulerStackCheck(void) {
+	if (*TASK_SCHEDULER_BOTTOM != TASK_STACK_PAINT) {
+		taskStackOverflow(0);
+	}
 }
+#endif
+
+void taskScheduler(void) {
+	#if TASK_STACK_CHECK
+	// currentTask is the task just switched out, if any. Coroutines have
+	// no stack of their own.
+	if (currentTask && currentTask->stackBottom != (uint8_t *)currentTask && *currentTask->stackBottom != TASK_STACK_PAINT) {
+		taskStackOverflow(currentTask);
+	}
 
+	// A coroutine ran on the scheduler stack until it waited or returned.
+	taskSchedulerStackCheck();
+	#endif
 
-static void taskYieldFromTimer(void) __attribute__((naked));
-static void taskYieldFromTimer(void) {
-	taskPush();
+	#if TASK_CPU_STATS
+	// The task switched out ran until now, or the CPU was idle. Time spent
+	// in here goes to whatever runs next.
+	taskCpuCharge(currentTask);
+	#endif
 
-	taskTick();
+	// A task that deleted itself is off its stack now.
+	if (currentTask && currentTask->state == TASK_STATE_DELETED) {
+		taskFree(currentTask);
+		currentTask = 0;
+	}
 
-	taskJmpScheduler();
-}
+	#if TASK_SCHED_EDF
+	// Queue the task switched out behind the others due at the same time,
+	// the round-robin among equals.
+	if (currentTask && currentTask->state == TASK_STATE_READY) {
+		taskReadyRemove(currentTask);
+		taskReadyInsert(currentTask);
+	}
+	#endif
 
-ISR(TIMER0_COMPA_vect, ISR_NAKED) {
-	taskYieldFromTimer();
+	for (;;) {
+		#if !TASK_SCHED_EDF
+		QUEUE *h, *q;
+		#endif
 
-	asm volatile ("reti");
-}
+		currentTask = 0;
+
+		#if TASK_SCHED_EDF
+		if (!QUEUE_EMPTY(&readyByDeadline)) {
+			currentTask = QUEUE_DATA(QUEUE_HEAD(&readyByDeadline), Task, member);
+		}
+		#else
+		if (readyMask) {
+			h = &readyTasks[taskHighestPriority()];
+			q = QUEUE_HEAD(h);
+
+			currentTask = QUEUE_DATA(q, Task, member);
+
+			QUEUE_ROTATE(h, q);
+		}
+		#endif
+
+		if (currentTask) {
+			TRACE_TASK(TRACE_SWITCH, currentTask);
+
+			#if TASK_QUANTUM
+			taskSlice = TASK_QUANTUM;
+			#endif
+
+			#if TASK_COROUTINES
+			if (currentTask->co) {
+				// Run it right here, up to its next wait or return. Either
+				// way taskYield() starts the scheduler over.
+				portIrqEnable();
+				currentTask->co(currentTask, currentTask->coData);
+				taskYield();
+			}
+			#endif
+
+			portSwitch();
+		}
 
-static void task__setup_timer() {
-	// Waveform generation mode: CTC
-	// WGM02: 0
-	// WGM01: 1
-	// WGM00: 0
-	TCCR0A = _BV(WGM01);
+		TRACE(TRACE_IDLE, 0);
 
-	TCCR0B = _TCCR0B;
+		portIdle();
 
-	OCR0A = COUNTS_PER_TICK - 1;
+		#if TASK_STACK_CHECK
+		// Interrupts taken while idle ran on the scheduler stack.
+		taskSchedulerStackCheck();
+		#endif
+
+		#if TASK_CPU_STATS
+		taskCpuCharge(0);
+		#endif
+	}
 }
 
 void taskInit(void) {
-	QUEUE_INIT(&readyTasks);
+	#if TASK_SCHED_EDF
+	QUEUE_INIT(&readyByDeadline);
+	taskUtilization = 0;
+	#else
+	uint8_t i;
+
+	for (i = 0; i < TASK_PRIORITIES; i++) {
+		QUEUE_INIT(&readyTasks[i]);
+	}
+	readyMask = 0;
+	#endif
+
 	QUEUE_INIT(&suspendedTasks);
 	QUEUE_INIT(&sleepingTasks);
 
-	task__setup_timer();
+	// Paint the scheduler stack like the task stacks. Nothing runs on it
+	// before taskStart().
+	memset(TASK_SCHEDULER_BOTTOM, TASK_STACK_PAINT, TASK_SCHEDULER_STACK);
+
+	#if TASK_POOL_TASKS
+	poolInit(&taskPool, taskSlots, TASK_SLOT_SIZE, TASK_POOL_TASKS);
+	#endif
+
+	portInit();
+
+	#if TASK_TRACE
+	traceInit();
+	#endif
 
 	#if TASK_COUNT_SEC
 	taskSetSecond(0);
@@ -439,40 +791,87 @@ void taskInit(void) {
 
 
 void taskStart(void) {
+	portStart();
+}
 
-	cli();
+void taskDelete(Task *t) {
+	PortIrqState irq;
+	Task **p;
 
+	irq = portIrqSave();
 
-	TIMSK0 |= _BV(OCIE0A);
+	if (t == 0) {
+		t = currentTask;
+	}
 
+	if (t->state == TASK_STATE_READY) {
+		taskReadyRemove(t);
+	} else {
+		QUEUE_REMOVE(&t->member);
+	}
+	taskTimerCancel(t);
 
-	taskJmpScheduler();
-}
+	for (p = &taskNewest; *p != t; p = &(*p)->older) {
+	}
+	*p = t->older;
 
-void taskYield(void) __attribute__((naked));
-void taskYield(void) {
-	taskPush();
+	#if TASK_SCHED_EDF
+	taskUtilization -= t->utilization;
+	#endif
 
-	taskJmpScheduler();
-}
+	t->state = TASK_STATE_DELETED;
+
+	if (t == currentTask) {
+		// Does not return, the scheduler frees the task.
+		taskYield();
+	}
 
+	taskFree(t);
+
+	portIrqRestore(irq);
+}
 
 Task *taskCurrent(void) {
 	return currentTask;
 }
 
+// Count the painted bytes left at the bottom of the stack.
+uint16_t taskStackHighWater(Task *t) {
+	uint8_t *bottom = t ? t->stackBottom : TASK_SCHEDULER_BOTTOM;
+	uint8_t *top = t ? (uint8_t *)t : taskSchedulerStack;
+	uint8_t *p = bottom;
+
+	while (p < top && *p == TASK_STACK_PAINT) {
+		p++;
+	}
+
+	return p - bottom;
+}
+
+#if TASK_STACK_CHECK
+// Default overflow hook: stop everything, the state can not be trusted.
+void taskStackOverflow(Task *t) __attribute__((weak));
+void taskStackOverflow(Task *t) {
+	portIrqSave();
+
+	for (;;) {
+	}
+}
+#endif
+
 void taskSuspendInternal(QUEUE *h) {
-	uint8_t sreg = SREG;
+	PortIrqState irq;
 
-	cli();
+	irq = portIrqSave();
 
-	QUEUE *q = &currentTask->member;
-	QUEUE_REMOVE(q);
-	QUEUE_INSERT_TAIL(h, q);
+	taskReadyRemove(currentTask);
+	QUEUE_INSERT_TAIL(h, &currentTask->member);
+	currentTask->state = TASK_STATE_BLOCKED;
+	TRACE_TASK(TRACE_SUSPEND, currentTask);
 
 	taskYield();
 
-	SREG = sreg;
+	portIrqRestore(irq);
 }
 
 
@@ -484,21 +883,336 @@ void taskSuspend(QUEUE *h) {
 	taskSuspendInternal(h);
 }
 
-// Wake up task.
+void taskSuspendPrio(QUEUE *h) {
+	PortIrqState irq;
+	QUEUE *q;
+
+	irq = portIrqSave();
+
+	// Queue behind the waiters of equal or higher priority.
+	QUEUE_FOREACH(q, h) {
+		if (taskOutranks(currentTask, QUEUE_DATA(q, Task, member))) {
+			break;
+		}
+	}
+
+	taskSuspendInternal(q);
+
+	portIrqRestore(irq);
+}
+
+// Give up the CPU if a ready task outranks the current one.
+void taskPreempt(void) {
+	PortIrqState irq;
+
+	irq = portIrqSave();
+
+	if (currentTask && TASK_PREEMPTIBLE(currentTask) && taskOutranked() && !portIsrDefer()) {
+		taskYield();
+	}
+
+	portIrqRestore(irq);
+}
+
+// Wake up task, switching to it at once if it outranks the current task.
 void taskWakeup(Task *t) {
-	uint8_t sreg = SREG;
+	PortIrqState irq;
 
-	cli();
+	irq = portIrqSave();
 
-	QUEUE *q = &t->member;
-	QUEUE_REMOVE(q);
-	QUEUE_INSERT_TAIL(&readyTasks, q);
+	taskReady(t);
+	taskPreempt();
 
-	SREG = sreg;
+	portIrqRestore(irq);
 }
 
-// Make current task sleep for specified number of ticks.
+void taskWakeupFromISR(Task *t) {
+	PortIrqState irq;
+
+	irq = portIrqSave();
+
+	taskReady(t);
+
+	portIrqRestore(irq);
+}
+
+#if !TASK_SCHED_EDF
+// Change the effective priority, moving t between ready queues if needed.
+static void taskSetPriority(Task *t, uint8_t priority) {
+	if (t->state == TASK_STATE_READY) {
+		taskReadyRemove(t);
+		t->priority = priority;
+		taskReadyInsert(t);
+	} else {
+		t->priority = priority;
+	}
+}
+
+#endif
+
+void taskPriorityInherit(Task *t, Task *from) {
+	PortIrqState irq;
+
+	irq = portIrqSave();
+
+	#if TASK_SCHED_EDF
+	if (taskOutranks(from, t)) {
+		taskSetDeadline(t, from->deadline, 1);
+	}
+	#else
+	if (from->priority > t->priority) {
+		taskSetPriority(t, from->priority);
+	}
+	#endif
+
+	portIrqRestore(irq);
+}
+
+void taskPriorityRestore(Task *t) {
+	PortIrqState irq;
+
+	irq = portIrqSave();
+
+	#if TASK_SCHED_EDF
+	if (t->deadline != t->baseDeadline || t->hasDeadline != (t->relDeadline != 0)) {
+		taskSetDeadline(t, t->baseDeadline, t->relDeadline != 0);
+		taskPreempt();
+	}
+	#else
+	if (t->priority != t->basePriority) {
+		taskSetPriority(t, t->basePriority);
+		taskPreempt();
+	}
+	#endif
+
+	portIrqRestore(irq);
+}
+
+// Insert task into sleepingTasks, which is ordered by wake-up time. Each
+// delay is kept relative to the task in front of it.
+static void taskSleepInsert(Task *t, uint16_t ticks) {
+	QUEUE *q;
+	Task *n;
+
+	QUEUE_FOREACH(q, &sleepingTasks) {
+		n = QUEUE_DATA(q, Task, timer);
+
+		if (ticks < n->delay) {
+			n->delay -= ticks;
+			break;
+		}
+
+		ticks -= n->delay;
+	}
+
+	t->delay = ticks;
+
+	// Link in front of q (the list head itself when t goes last).
+	QUEUE_INSERT_TAIL(q, &t->timer);
+}
+
+uint16_t taskMsToTicks(uint16_t ms) {
+	// Rounded up, a wait never counts fewer than ms worth of ticks.
+	return TASK_MS_TO_TICKS(ms);
+}
+
+static void taskSleepTicks(uint16_t ticks) {
+	PortIrqState irq;
+
+	irq = portIrqSave();
+
+	taskReadyRemove(currentTask);
+	QUEUE_INIT(&currentTask->member);
+	taskSleepInsert(currentTask, ticks);
+	currentTask->state = TASK_STATE_SLEEPING;
+	TRACE_TASK(TRACE_SLEEP, currentTask);
+
+	taskYield();
+
+	portIrqRestore(irq);
+}
+
+// Make current task sleep for specified number of milliseconds.
 void taskSleep(uint16_t ms) {
-	currentTask->delay = ms / MS_PER_TICK;
-	taskSuspendInternal(&sleepingTasks);
+	taskSleepTicks(taskMsToTicks(ms));
+}
+
+TASK_TICK_T taskTickCount(void) {
+	PortIrqState irq;
+	TASK_TICK_T ticks;
+
+	irq = portIrqSave();
+	ticks = taskTicks;
+	portIrqRestore(irq);
+
+	return ticks;
+}
+
+uint8_t taskDelayUntil(TASK_TICK_T *lastWake, TASK_TICK_T period) {
+	PortIrqState irq;
+	TASK_TICK_T next = *lastWake + period;
+	TASK_TICK_T late;
+	uint8_t passed;
+	uint8_t missed;
+
+	irq = portIrqSave();
+
+	late = taskTicks - next;
+	passed = late != 0 && late <= TASK_TICK_HALF;
+	missed = passed;
+
+	#if TASK_SCHED_EDF
+	// A deadline shorter than the period can pass before the next release.
+	if (currentTask->relDeadline && TASK_TICK_BEFORE(currentTask->baseDeadline, taskTicks)) {
+		missed = 1;
+	}
+	#endif
+
+	if (missed) {
+		currentTask->overruns++;
+		taskDeadlineMiss(currentTask);
+	}
+
+	if (passed) {
+		next += late / period * period;
+
+		#if TASK_SCHED_EDF
+		// The job of the release that passed starts right away.
+		if (currentTask->relDeadline) {
+			taskRelease(currentTask, next);
+			taskSetDeadline(currentTask, currentTask->deadline, 1);
+			taskPreempt();
+		}
+		#endif
+	} else {
+		// Sleeps are 16 bits, a longer wait takes several of them.
+		while ((late = next - taskTicks) != 0 && late <= TASK_TICK_HALF) {
+			taskSleepTicks(late > 0xFFFF ? 0xFFFF : late);
+		}
+	}
+
+	*lastWake = next;
+
+	portIrqRestore(irq);
+
+	return missed;
+}
+
+void taskDeadlineMiss(Task *t) __attribute__((weak));
+void taskDeadlineMiss(Task *t) {
+}
+
+uint8_t taskSuspendTimeout(QUEUE *h, uint16_t ms) {
+	PortIrqState irq;
+	uint8_t timeout;
+
+	irq = portIrqSave();
+
+	currentTask->timeout = 0;
+	taskSleepInsert(currentTask, taskMsToTicks(ms));
+	taskSuspendPrio(h);
+	timeout = currentTask->timeout;
+
+	portIrqRestore(irq);
+
+	return timeout;
+}
+
+#if TASK_NOTIFY
+// Update t's value, returns 1 when t has to be woken. A timed out waiter
+// is ready already and keeps its wait flag until it runs.
+static uint8_t taskNotifyPost(Task *t, uint16_t value, uint8_t action) {
+	switch (action) {
+	case TASK_NOTIFY_BITS:
+		t->notifyValue |= value;
+		break;
+
+	case TASK_NOTIFY_INCREMENT:
+		t->notifyValue++;
+		break;
+
+	default:
+		t->notifyValue = value;
+		break;
+	}
+
+	if ((t->notify & TASK_NOTIFY_WAITING) && t->state == TASK_STATE_BLOCKED) {
+		t->notify = TASK_NOTIFY_PENDING;
+		return 1;
+	}
+
+	t->notify |= TASK_NOTIFY_PENDING;
+	return 0;
+}
+
+void taskNotify(Task *t, uint16_t value, uint8_t action) {
+	PortIrqState irq;
+
+	irq = portIrqSave();
+
+	if (taskNotifyPost(t, value, action)) {
+		taskReady(t);
+		taskPreempt();
+	}
+
+	portIrqRestore(irq);
+}
+
+void taskNotifyFromISR(Task *t, uint16_t value, uint8_t action) {
+	PortIrqState irq;
+
+	irq = portIrqSave();
+
+	if (taskNotifyPost(t, value, action)) {
+		taskReady(t);
+	}
+
+	portIrqRestore(irq);
+}
+
+uint16_t taskNotifyWait(void) {
+	PortIrqState irq;
+	uint16_t value;
+
+	irq = portIrqSave();
+
+	if (!(currentTask->notify & TASK_NOTIFY_PENDING)) {
+		currentTask->notify = TASK_NOTIFY_WAITING;
+		taskSuspendInternal(&suspendedTasks);
+	}
+
+	value = currentTask->notifyValue;
+	currentTask->notifyValue = 0;
+	currentTask->notify = 0;
+
+	portIrqRestore(irq);
+
+	return value;
+}
+
+uint8_t taskNotifyWaitTimeout(uint16_t *value, uint16_t ms) {
+	PortIrqState irq;
+	uint8_t result = TASK_NOTIFY_OK;
+
+	irq = portIrqSave();
+
+	if (!(currentTask->notify & TASK_NOTIFY_PENDING) && ms) {
+		currentTask->notify = TASK_NOTIFY_WAITING;
+		taskSuspendTimeout(&suspendedTasks, ms);
+	}
+
+	if (currentTask->notify & TASK_NOTIFY_PENDING) {
+		if (value) {
+			*value = currentTask->notifyValue;
+		}
+		currentTask->notifyValue = 0;
+	} else {
+		result = TASK_NOTIFY_TIMEOUT;
+	}
+	currentTask->notify = 0;
+
+	portIrqRestore(irq);
+
+	return result;
 }
+#endif
@@ -11,58 +11,272 @@
 
 #include <stdint.h>
 
+#include "config.h"
 #include "queue.h"
-#define F_CPU 16000000L
-#ifndef F_CPU
-#error "Define F_CPU"
+
+#if 1000 % MS_PER_TICK
+#error "MS_PER_TICK must divide 1000"
 #endif
 
-#define MS_PER_TICK 2
 #define US_PER_TICK (1000 * MS_PER_TICK)
 #define US_PER_COUNT (US_PER_TICK / COUNTS_PER_TICK)
 
-#if F_CPU == 16000000L
-// Clock select: prescaler = 1/256
-#define _TCCR0B (_BV(CS02))
-#define COUNTS_PER_TICK ((F_CPU / 256) / (1000 / MS_PER_TICK))
-#elif F_CPU == 8000000L
-// Clock select: prescaler = 1/64
-#define _TCCR0B (_BV(CS01) | _BV(CS00))
-#define COUNTS_PER_TICK ((F_CPU / 64) / (1000 / MS_PER_TICK))
+// Ticks for ms milliseconds, rounded up and at least 1, like
+// taskMsToTicks(). Constant for a constant ms, e.g. taskDelayUntil() periods.
+#define TASK_MS_TO_TICKS(ms) ((ms) <= MS_PER_TICK ? 1 : ((uint32_t)(ms) + MS_PER_TICK - 1) / MS_PER_TICK)
+
+// Half the tick range. A tick count less than this behind another one is
+// taken to be in the past, anything else in the future.
+#define TASK_TICK_HALF ((TASK_TICK_T)~(TASK_TICK_T)0 / 2)
+
+// Tick a comes strictly before tick b.
+#define TASK_TICK_BEFORE(a, b) ((TASK_TICK_T)((b) - (a) - 1) < TASK_TICK_HALF)
+
+typedef void (*TaskFunction)(void *);
+
+// Architecture: context switching, tick source and interrupt masking.
+#ifdef __AVR__
+#include "port_avr.h"
 #else
-#error "Unsupported F_CPU"
+#include "port_host.h"
 #endif
 
-typedef void (*TaskFunction)(void *);
+#if TASK_PRIORITIES > 8
+#error "TASK_PRIORITIES must not exceed 8"
+#endif
+
+#define TASK_PRIORITY_DEFAULT 0
+
+// Static memory shared by task stacks, their TCBs and the scheduler stack.
+#ifndef TASK_ARENA_SIZE
+#define TASK_ARENA_SIZE 1280
+#endif
+
+// Scheduler stack, right above the first task's TCB. Besides the scheduler
+// it holds an interrupt taken while idle, its whole handler unless
+// TASK_ISR_STACK is set, and with TASK_COROUTINES the deepest call chain
+// of a coroutine plus such an interrupt. With TASK_STACK_CHECK its bottom
+// byte is checked like a task's, taskStackHighWater(0) shows the margin.
+#ifndef TASK_SCHEDULER_STACK
+#define TASK_SCHEDULER_STACK 64
+#endif
+
+// Stack size for taskCreate() and taskCreatePrio().
+#ifndef TASK_STACK_DEFAULT
+#define TASK_STACK_DEFAULT 0x100
+#endif
+
+// Room for the initial context frame plus a few bytes.
+#ifndef TASK_STACK_MIN
+#define TASK_STACK_MIN 40
+#endif
+
+// Byte new stacks are filled with.
+#define TASK_STACK_PAINT 0xA5
+
+#define TASK_STATE_READY 0
+#define TASK_STATE_SLEEPING 1
+#define TASK_STATE_BLOCKED 2
+#define TASK_STATE_DELETED 3
+
+#if TASK_NOTIFY
+// How taskNotify() updates the notification value.
+#define TASK_NOTIFY_BITS 0 // OR value in.
+#define TASK_NOTIFY_INCREMENT 1 // Add 1, value is ignored.
+#define TASK_NOTIFY_OVERWRITE 2 // Replace it with value.
+
+// Results of taskNotifyWaitTimeout().
+#define TASK_NOTIFY_OK 0
+#define TASK_NOTIFY_TIMEOUT 1
+#endif
 
 typedef struct TaskStruct Task;
 
+// Body of a stackless task, see coroutine.h.
+typedef void (*TaskCoroutine)(Task *t, void *data);
+
 struct TaskStruct {
-	void *stackPointer; // Stack pointer this task can be resumed from.
-	uint16_t delay; // Ticks until task can be scheduled again.
+	PortContext context; // Saved by the port when switched out, keep first.
+	uint16_t delay; // Ticks to wake-up, relative to the previous sleeper.
+	uint8_t priority; // Higher value is scheduled first, may be inherited.
+	uint8_t basePriority; // Priority given at creation.
+	uint8_t state; // TASK_STATE_*, which kind of queue member is on.
+	uint8_t id; // Creation order starting at 1, names the task in traces.
+	uint8_t mutexes; // Mutexes currently held.
+	uint8_t timeout; // Set when the last taskSuspendTimeout() ran out.
+	void *waitData; // Owned by the object the task waits on.
+	uint8_t *stackBottom; // Lowest byte of the stack, right above the next TCB.
+	Task *older; // Task created before this one, links all of them.
+	uint16_t overruns; // Release times taskDelayUntil() found already past.
+	#if TASK_SCHED_EDF
+	uint32_t utilization; // Share of the CPU admitted, 1 is 0x10000.
+	uint16_t relDeadline; // Ticks from release to deadline, 0 for none.
+	uint8_t hasDeadline; // Clear to run after every task with a deadline.
+	TASK_TICK_T deadline; // Effective absolute deadline, may be inherited.
+	TASK_TICK_T baseDeadline; // Deadline of the current job.
+	#endif
+	#if TASK_CPU_STATS
+	uint32_t cpu; // Timer counts spent running since the last reset.
+	#endif
+	#if TASK_COROUTINES
+	TaskCoroutine co; // Set for a stackless task.
+	void *coData;
+	uint16_t line; // Where co resumes, 0 for its start.
+	#endif
+	#if TASK_NOTIFY
+	uint16_t notifyValue; // Updated by taskNotify(), cleared by the wait.
+	uint8_t notify; // Pending and waiting flags.
+	#endif
 
-	QUEUE member;
+	QUEUE member; // Link in a ready or wait queue.
+	QUEUE timer; // Link in the sleep queue, for sleeps and timed waits.
 };
 
 void taskInit(void);
 
+// The create functions may be called before taskStart() or from a task,
+// not from an ISR. A new task that outranks the calling one runs at once,
+// before the call returns.
 Task *taskCreate(TaskFunction fn, void *data);
 
+Task *taskCreatePrio(TaskFunction fn, void *data, uint8_t priority);
+
+// Returns 0 when the arena cannot fit stackSize bytes plus the TCB.
+Task *taskCreateEx(TaskFunction fn, void *data, uint16_t stackSize);
+
+#if TASK_COROUTINES
+// A task without a stack: fn(t, data) runs on the scheduler stack each
+// time the task is scheduled, see coroutine.h. Costs only the TCB.
+Task *taskCreateCoroutine(TaskCoroutine fn, void *data, uint8_t priority);
+#endif
+
+#if TASK_SCHED_EDF
+// With TASK_SCHED_EDF=1 the ready task with the earliest absolute deadline
+// runs, priorities are ignored. Tasks from the other create functions have
+// no deadline and share the CPU round-robin when no deadline task is ready.
+//
+// Create a task that has to finish each job, at most wcet ticks of work,
+// within deadline ticks of its release (0 for the period). A job is
+// released at creation and whenever the task wakes from a sleep, like
+// taskDelayUntil(&lastWake, period). Returns 0 when the sum of
+// wcet / min(deadline, period) over all deadline tasks would exceed 1, or
+// when the arena is full.
+Task *taskCreateDeadline(TaskFunction fn, void *data, uint16_t stackSize, uint16_t wcet, uint16_t period, uint16_t deadline);
+#endif
+
 void taskStart(void);
 
+// Stop t and give back its memory, t = 0 for the calling task. A pooled
+// task's slot (TASK_POOL_TASKS) can be reused at once, arena memory only
+// when t was the last task created there. t must not hold a mutex. Not
+// for use from ISRs.
+void taskDelete(Task *t);
+
 
 void taskYield(void);
 
 
 Task *taskCurrent(void);
 
+// Bytes of t's stack that were never used, the smallest free margin seen.
+// t = 0 gives the scheduler stack.
+uint16_t taskStackHighWater(Task *t);
+
+#if TASK_CPU_STATS
+typedef struct {
+	Task *task; // 0 for the time spent idle.
+	uint32_t time; // Timer counts, US_PER_COUNT microseconds each.
+} TaskCpuStat;
+
+// Timer counts t has run for since the last reset, t = 0 gives idle time.
+uint32_t taskCpuTime(Task *t);
+
+// Fill stats with the idle time followed by the time of every task, newest
+// first, at most n entries. With reset set all counters restart from zero
+// at the same instant. Returns the number of entries filled.
+uint8_t taskCpuSnapshot(TaskCpuStat *stats, uint8_t n, uint8_t reset);
+#endif
+
+#if TASK_STACK_CHECK
+// Called from the scheduler when a task switched out has written the
+// bottom byte of its stack, with t = 0 when the scheduler stack has. Weak,
+// define it to install another handler. The default one disables
+// interrupts and hangs.
+void taskStackOverflow(Task *t);
+#endif
+
 void taskSuspend(QUEUE *h);
 
+// Like taskSuspend(), but h is kept ordered by priority, highest first.
+void taskSuspendPrio(QUEUE *h);
+
+// Like taskSuspendPrio(), but give up after ms milliseconds. Returns 1 when
+// the wait timed out, the task has then been taken off h again.
+uint8_t taskSuspendTimeout(QUEUE *h, uint16_t ms);
+
 
 void taskWakeup(Task *t);
 
+// Make t ready without switching to it. Usable from interrupts, which
+// should then end with taskPreempt().
+void taskWakeupFromISR(Task *t);
+
+// Yield if a ready task outranks the current one. Call it last in an ISR
+// that woke tasks, so the woken task runs as soon as the ISR returns.
+// In a plain ISR it switches from inside the handler, which is then not
+// to be nested. In a TASK_ISR handler it only marks the switch, done as
+// the handler returns, which is cheaper.
+void taskPreempt(void);
+
+#if TASK_NOTIFY
+// Notifications signal a task directly, without a semaphore or event object
+// in between: each task has a notification value, and waking the one task
+// waiting on it needs no queue search. Only the task itself can wait.
+//
+// Update t's notification value by action, TASK_NOTIFY_*, and mark it
+// pending. Wakes t if it waits in taskNotifyWait().
+void taskNotify(Task *t, uint16_t value, uint8_t action);
+
+// Like taskNotify() from an interrupt. End the ISR with taskPreempt().
+void taskNotifyFromISR(Task *t, uint16_t value, uint8_t action);
+
+// Wait until a notification is pending, then return the value and clear
+// it. With TASK_NOTIFY_INCREMENT this is the number of notifications.
+uint16_t taskNotifyWait(void);
+
+// Wait at most ms milliseconds, 0 does not wait at all. The value is
+// stored to *value unless that is 0.
+uint8_t taskNotifyWaitTimeout(uint16_t *value, uint16_t ms);
+#endif
+
 void taskSleep(uint16_t ms);
 
+// Ticks since taskInit().
+TASK_TICK_T taskTickCount(void);
+
+// Ticks to wait for ms milliseconds, rounded up and at least 1, so a wait
+// counts at least ms worth of ticks whatever MS_PER_TICK is.
+uint16_t taskMsToTicks(uint16_t ms);
+
+// Sleep until tick *lastWake + period and move *lastWake there, so a
+// periodic task keeps its rate however long its body runs. Start with
+// *lastWake = taskTickCount(). Returns 1 and skips the sleep when that
+// release time has passed already: the overrun is counted in the task,
+// taskDeadlineMiss() is called and *lastWake moves to the last release
+// that passed, dropping the missed ones. period must not be 0. With
+// TASK_SCHED_EDF a job finishing after its deadline is an overrun too.
+uint8_t taskDelayUntil(TASK_TICK_T *lastWake, TASK_TICK_T period);
+
+// Called by taskDelayUntil() with interrupts disabled on an overrun. Weak,
+// the default one does nothing.
+void taskDeadlineMiss(Task *t);
+
+// Raise t to from's priority if that is higher.
+void taskPriorityInherit(Task *t, Task *from);
+
+// Drop t back to its base priority, yielding if it no longer runs first.
+void taskPriorityRestore(Task *t);
+
 #if TASK_COUNT_SEC
 #ifndef TASK_SEC_T
 #define TASK_SEC_T uint16_t
@@ -0,0 +1,1201 @@
+/*
+ * host_kernel.c
+ *
+ * Created: 10/16/2026 10:34:51 PM
+ *  Author: Alex Ionita
+ *
+ * Kernel tests on the host port. Each test gets a fresh kernel in a child
+ * process, the tasks it creates end it with exit(0) or a failed CHECK().
+ * Build and run, from the repository root:
+ *
+ *   gcc -Wall -I. -DTASK_HOST_VIRTUAL_TIME=1 -DTASK_NOTIFY=1 \
+ *     -DTASK_COROUTINES=1 -o host_kernel tests/host_kernel.c task.c \
+ *     mutex.c semaphore.c event.c message.c pool.c timer.c ring.c trace.c \
+ *     port_host.c
+ *   ./host_kernel
+ *
+ * It prints a line per test and exits with 1 if any of them failed. Tests
+ * of features left out of the build are skipped, build again with e.g.
+ * -DTASK_QUANTUM=4, -DTASK_SCHED_EDF=1, -DTASK_TRACE=1 or -DMS_PER_TICK=10
+ * to cover those settings. The tests relying on fixed priorities are
+ * skipped under EDF.
+ */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "task.h"
+#include "coroutine.h"
+#include "event.h"
+#include "message.h"
+#include "mutex.h"
+#include "pool.h"
+#include "port.h"
+#include "ring.h"
+#include "semaphore.h"
+#include "timer.h"
+#include "trace.h"
+
+// Milliseconds a test may take in real time before it counts as hung. The
+// longest spins for 100 ticks.
+#define TEST_TIMEOUT (10000 + 100 * MS_PER_TICK)
+
+// Milliseconds in n ticks. Waits are given in ticks, so the tests hold at
+// any MS_PER_TICK.
+#define TICKS(n) ((n) * MS_PER_TICK)
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("  %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+			exit(1); \
+		} \
+	} while (0)
+
+typedef struct {
+	const char *name;
+	void (*setup)(void); // Creates the tasks, runs before taskStart().
+} Test;
+
+static Semaphore testSemaphore;
+
+static EventGroup testEvents;
+
+static MessageQueue testQueue;
+
+static void *testQueueBuffer[2];
+
+
+// Burn CPU time until ticks have passed.
+static void testSpin(TASK_TICK_T ticks) {
+	TASK_TICK_T start = taskTickCount();
+
+	while ((TASK_TICK_T)(taskTickCount() - start) < ticks) {
+	}
+}
+
+static void sleepTask(void *data) {
+	TASK_TICK_T start;
+	TASK_TICK_T elapsed;
+
+	start = taskTickCount();
+	taskSleep(TICKS(10));
+	elapsed = taskTickCount() - start;
+	CHECK(elapsed >= 10 && elapsed <= 11);
+	exit(0);
+}
+
+static void testSleep(void) {
+	taskCreate(sleepTask, 0);
+}
+
+// Waits that are not a whole number of ticks round up: 15 ms are 8 ticks
+// of the default 2 ms, or 2 ticks with -DMS_PER_TICK=10.
+static void sleepRoundTask(void *data) {
+	TASK_TICK_T start;
+	TASK_TICK_T elapsed;
+
+	start = taskTickCount();
+	taskSleep(15);
+	elapsed = taskTickCount() - start;
+	CHECK(elapsed * MS_PER_TICK >= 15 && elapsed * MS_PER_TICK < 15 + MS_PER_TICK);
+
+	start = taskTickCount();
+	CHECK(semaphoreTakeTimeout(&testSemaphore, 15) == SEMAPHORE_TIMEOUT);
+	elapsed = taskTickCount() - start;
+	CHECK(elapsed * MS_PER_TICK >= 15 && elapsed * MS_PER_TICK < 15 + MS_PER_TICK);
+	exit(0);
+}
+
+static void testSleepRound(void) {
+	semaphoreInit(&testSemaphore, 0);
+	taskCreate(sleepRoundTask, 0);
+}
+
+// Releases stay on the period while the body runs shorter than it, an
+// overrun skips the sleep and is counted.
+static void delayUntilTask(void *data) {
+	TASK_TICK_T start;
+	TASK_TICK_T last;
+	uint8_t i;
+
+	start = taskTickCount();
+	last = start;
+
+	for (i = 1; i <= 10; i++) {
+		testSpin(2);
+		CHECK(taskDelayUntil(&last, 5) == 0);
+		CHECK(last == (TASK_TICK_T)(start + 5 * i));
+		CHECK((TASK_TICK_T)(taskTickCount() - last) <= 1);
+	}
+
+	testSpin(12);
+	CHECK(taskDelayUntil(&last, 5) == 1);
+	CHECK(taskCurrent()->overruns == 1);
+	exit(0);
+}
+
+static void testDelayUntil(void) {
+	taskCreate(delayUntilTask, 0);
+}
+
+static void advanceSleeper(void *data) {
+	taskSleep(TICKS((uintptr_t)data));
+	taskSuspend(0);
+}
+
+// A port handing over more ticks than the first sleeper had left wakes it
+// and counts the rest off the next one.
+static void advanceLateTask(void *data) {
+	PortIrqState irq;
+	Task *a;
+	Task *b;
+
+	a = taskCreatePrio(advanceSleeper, (void *)5, 1);
+	b = taskCreatePrio(advanceSleeper, (void *)10, 1);
+	taskSleep(TICKS(1));
+
+	irq = portIrqSave();
+	taskAdvance(5 + 3);
+	CHECK(a->state == TASK_STATE_READY);
+	CHECK(b->state == TASK_STATE_SLEEPING);
+	CHECK(b->delay >= 1 && b->delay <= 5 - 3);
+	portIrqRestore(irq);
+	exit(0);
+}
+
+static void testAdvanceLate(void) {
+	taskCreatePrio(advanceLateTask, 0, 2);
+}
+
+static volatile uint8_t createRan;
+
+static void createdTask(void *data) {
+	createRan++;
+	taskSuspend(0);
+}
+
+// A new task that outranks its creator runs before the create call
+// returns, one of the same rank waits its turn.
+static void createTask(void *data) {
+	#if TASK_SCHED_EDF
+	CHECK(taskCreateDeadline(createdTask, 0, TASK_STACK_DEFAULT, 1, 10, 0) != 0);
+	#else
+	CHECK(taskCreatePrio(createdTask, 0, 2) != 0);
+	#endif
+	CHECK(createRan == 1);
+
+	CHECK(taskCreatePrio(createdTask, 0, 1) != 0);
+	CHECK(createRan == 1);
+	exit(0);
+}
+
+static void testCreatePreempt(void) {
+	taskCreatePrio(createTask, 0, 1);
+}
+
+#if !TASK_SCHED_EDF
+static volatile uint8_t quantumLast;
+
+static volatile uint16_t quantumHandoffs;
+
+// Two busy tasks of the same priority take turns every TASK_QUANTUM ticks.
+static void quantumTask(void *data) {
+	uint8_t me = data != 0;
+
+	for (;;) {
+		if (quantumLast != me) {
+			quantumLast = me;
+			quantumHandoffs++;
+		}
+
+		if (taskTickCount() >= 100) {
+			#if TASK_QUANTUM
+			CHECK(quantumHandoffs >= 100 / TASK_QUANTUM - 1);
+			CHECK(quantumHandoffs <= 100 / TASK_QUANTUM + 2);
+			#else
+			CHECK(quantumHandoffs == 1);
+			#endif
+			exit(0);
+		}
+	}
+}
+
+static void testQuantum(void) {
+	quantumLast = 0;
+	taskCreatePrio(quantumTask, (void *)1, 1);
+	taskCreatePrio(quantumTask, 0, 1);
+}
+#endif
+
+static void semaphoreGiver(void *data) {
+	taskSleep(TICKS(15));
+	semaphoreGive(&testSemaphore);
+	taskSuspend(0);
+}
+
+static void semaphoreTimeoutTask(void *data) {
+	TASK_TICK_T start;
+	TASK_TICK_T elapsed;
+
+	CHECK(semaphoreTakeTimeout(&testSemaphore, 0) == SEMAPHORE_TIMEOUT);
+
+	start = taskTickCount();
+	CHECK(semaphoreTakeTimeout(&testSemaphore, TICKS(5)) == SEMAPHORE_TIMEOUT);
+	elapsed = taskTickCount() - start;
+	CHECK(elapsed >= 5 && elapsed <= 6);
+
+	// The giver wakes up 15 ticks after the start.
+	CHECK(semaphoreTakeTimeout(&testSemaphore, TICKS(50)) == SEMAPHORE_OK);
+	CHECK(taskTickCount() - start <= 15 + 1);
+	CHECK(testSemaphore.count == 0);
+	exit(0);
+}
+
+static void testSemaphoreTimeout(void) {
+	semaphoreInit(&testSemaphore, 0);
+	taskCreatePrio(semaphoreTimeoutTask, 0, 2);
+	taskCreatePrio(semaphoreGiver, 0, 1);
+}
+
+static void messageTimeoutTask(void *data) {
+	void *msg;
+	TASK_TICK_T start;
+
+	CHECK(messageReceiveTimeout(&testQueue, &msg, 0) == MESSAGE_TIMEOUT);
+	CHECK(messageReceiveTimeout(&testQueue, &msg, TICKS(5)) == MESSAGE_TIMEOUT);
+
+	CHECK(messageSendTimeout(&testQueue, &start, 0) == MESSAGE_OK);
+	CHECK(messageSendTimeout(&testQueue, &msg, 0) == MESSAGE_OK);
+	CHECK(messageSendTimeout(&testQueue, &msg, TICKS(5)) == MESSAGE_TIMEOUT);
+
+	CHECK(messageReceiveTimeout(&testQueue, &msg, 0) == MESSAGE_OK);
+	CHECK(msg == &start);
+	exit(0);
+}
+
+static void testMessageTimeout(void) {
+	messageInit(&testQueue, testQueueBuffer, 2);
+	taskCreate(messageTimeoutTask, 0);
+}
+
+static void *messageLargeBuffer[200];
+
+// In a queue of more than 128 slots head + count passes 255, the messages
+// still go to the right slots.
+static void messageLargeTask(void *data) {
+	uintptr_t i;
+	void *msg;
+
+	for (i = 0; i < 150; i++) {
+		CHECK(messageSendTimeout(&testQueue, (void *)i, 0) == MESSAGE_OK);
+		CHECK(messageReceiveTimeout(&testQueue, &msg, 0) == MESSAGE_OK);
+	}
+
+	for (i = 0; i < 200; i++) {
+		CHECK(messageSendTimeout(&testQueue, (void *)i, 0) == MESSAGE_OK);
+	}
+	CHECK(messageSendTimeout(&testQueue, (void *)i, 0) == MESSAGE_TIMEOUT);
+
+	for (i = 0; i < 200; i++) {
+		CHECK(messageReceiveTimeout(&testQueue, &msg, 0) == MESSAGE_OK);
+		CHECK(msg == (void *)i);
+	}
+	exit(0);
+}
+
+static void testMessageLarge(void) {
+	messageInit(&testQueue, messageLargeBuffer, 200);
+	taskCreate(messageLargeTask, 0);
+}
+
+#if !TASK_SCHED_EDF
+static Task *messageReceiver;
+
+static uint8_t messagePayload;
+
+static volatile uint8_t messageSteps;
+
+static volatile uint8_t messageIsrResult;
+
+// A blocked receiver is handed the message directly and, ranking higher,
+// runs before the send returns. The buffer is not used.
+static void messageHandoffReceiver(void *data) {
+	CHECK(messageReceive(&testQueue) == &messagePayload);
+	CHECK(testQueue.count == 0);
+	messageSteps++;
+	taskSuspend(0);
+}
+
+static void messageHandoffSender(void *data) {
+	CHECK(messageReceiver->state == TASK_STATE_BLOCKED);
+	messageSend(&testQueue, &messagePayload);
+	CHECK(messageSteps == 1);
+	CHECK(testQueue.count == 0);
+	exit(0);
+}
+
+static void testMessageHandoff(void) {
+	messageInit(&testQueue, testQueueBuffer, 2);
+	messageReceiver = taskCreatePrio(messageHandoffReceiver, 0, 2);
+	taskCreatePrio(messageHandoffSender, 0, 1);
+}
+
+// Stands in for a device interrupt.
+static void messageIsr(int sig) {
+	messageIsrResult = messageSendFromISR(&testQueue, &messagePayload);
+	taskPreempt();
+}
+
+// A send from an ISR wakes the blocked receiver, which runs as soon as the
+// ISR returns. With nobody waiting the queue fills, then refuses.
+static void messageIsrSender(void *data) {
+	struct sigaction sa;
+
+	sa.sa_handler = messageIsr;
+	sa.sa_flags = 0;
+	PORT_IRQ_SIGNALS(&sa.sa_mask);
+	sigaction(SIGUSR1, &sa, 0);
+
+	CHECK(messageReceiver->state == TASK_STATE_BLOCKED);
+	raise(SIGUSR1);
+	CHECK(messageIsrResult == MESSAGE_OK);
+	CHECK(messageSteps == 1);
+
+	raise(SIGUSR1);
+	CHECK(messageIsrResult == MESSAGE_OK);
+	raise(SIGUSR1);
+	CHECK(messageIsrResult == MESSAGE_OK);
+	raise(SIGUSR1);
+	CHECK(messageIsrResult == MESSAGE_TIMEOUT);
+	CHECK(testQueue.count == 2);
+	exit(0);
+}
+
+static void testMessageIsr(void) {
+	messageInit(&testQueue, testQueueBuffer, 2);
+	messageReceiver = taskCreatePrio(messageHandoffReceiver, 0, 2);
+	taskCreatePrio(messageIsrSender, 0, 1);
+}
+
+// Without a buffer the sender waits for the receiver, which takes the
+// message from it directly.
+static void messageRendezvousSender(void *data) {
+	messageSend(&testQueue, &messagePayload);
+	CHECK(messageSteps == 0);
+	messageSteps = 1;
+	taskSuspend(0);
+}
+
+static void messageRendezvousReceiver(void *data) {
+	void *msg;
+
+	taskSleep(TICKS(5));
+	CHECK(messageSteps == 0);
+	CHECK(messageReceiveTimeout(&testQueue, &msg, 0) == MESSAGE_OK);
+	CHECK(msg == &messagePayload);
+	CHECK(messageSteps == 1);
+	CHECK(messageSendTimeout(&testQueue, &msg, 0) == MESSAGE_TIMEOUT);
+	exit(0);
+}
+
+static void testMessageRendezvous(void) {
+	messageInit(&testQueue, 0, 0);
+	taskCreatePrio(messageRendezvousSender, 0, 2);
+	taskCreatePrio(messageRendezvousReceiver, 0, 1);
+}
+#endif
+
+// Sets the bits of the event test one after the other, each after 2 ticks.
+static void eventSetter(void *data) {
+	static const EventBits sets[] = {0x01, 0x02, 0x20, 0x05};
+	uint8_t i;
+
+	for (i = 0; i < sizeof(sets); i++) {
+		taskSleep(TICKS(2));
+		eventSet(&testEvents, sets[i]);
+	}
+
+	taskSuspend(0);
+}
+
+static void eventTask(void *data) {
+	TASK_TICK_T start;
+	TASK_TICK_T elapsed;
+
+	// Wait all, satisfied by the first two sets together.
+	CHECK(eventWait(&testEvents, 0x03, EVENT_WAIT_ALL) == 0x03);
+	CHECK(testEvents.bits == 0x03);
+	eventClear(&testEvents, 0x03);
+
+	// Wait any with clear, 0x20 does not match, 0x05 does. Only the
+	// awaited bits are cleared.
+	CHECK(eventWait(&testEvents, 0x0C, EVENT_WAIT_ANY | EVENT_CLEAR) == 0x25);
+	CHECK(testEvents.bits == 0x21);
+
+	CHECK(eventWaitTimeout(&testEvents, 0x80, EVENT_WAIT_ANY, 0) == 0x21);
+
+	start = taskTickCount();
+	CHECK(eventWaitTimeout(&testEvents, 0x81, EVENT_WAIT_ALL, TICKS(5)) == 0x21);
+	elapsed = taskTickCount() - start;
+	CHECK(elapsed >= 5 && elapsed <= 6);
+	CHECK(QUEUE_EMPTY(&testEvents.waiting));
+	exit(0);
+}
+
+static void testEvent(void) {
+	eventInit(&testEvents);
+	taskCreatePrio(eventTask, 0, 2);
+	taskCreatePrio(eventSetter, 0, 1);
+}
+
+// The scheduler stack is painted and used, idle included, without
+// running out.
+static void schedulerStackTask(void *data) {
+	uint16_t free;
+
+	taskSleep(TICKS(5));
+	taskSleep(TICKS(5));
+	free = taskStackHighWater(0);
+	CHECK(free > 0 && free < TASK_SCHEDULER_STACK);
+	exit(0);
+}
+
+static void testSchedulerStack(void) {
+	taskCreate(schedulerStackTask, 0);
+}
+
+static POOL_BUFFER(poolBuffer, 24, 3);
+
+static Pool testPool;
+
+static void poolTask(void *data) {
+	PoolStats stats;
+	void *a;
+	void *b;
+	void *c;
+
+	poolInit(&testPool, poolBuffer, 24, 3);
+	a = poolAlloc(&testPool);
+	b = poolAlloc(&testPool);
+	c = poolAlloc(&testPool);
+	CHECK(a && b && c && a != b && b != c && a != c);
+	CHECK(poolAlloc(&testPool) == 0);
+
+	poolFree(&testPool, b);
+	CHECK(poolAlloc(&testPool) == b);
+
+	poolFree(&testPool, a);
+	poolStats(&testPool, &stats, 1);
+	CHECK(stats.count == 3 && stats.inUse == 2 && stats.peak == 3 && stats.failures == 1);
+	poolStats(&testPool, &stats, 0);
+	CHECK(stats.peak == 2 && stats.failures == 0);
+	exit(0);
+}
+
+static void testPoolBlocks(void) {
+	taskCreate(poolTask, 0);
+}
+
+static volatile uint16_t deleteRuns;
+
+static volatile uint8_t deleteNewRan;
+
+static void deleteVictim(void *data) {
+	for (;;) {
+		deleteRuns++;
+		taskSleep(TICKS(1));
+	}
+}
+
+static void deleteSelf(void *data) {
+	taskDelete(0);
+	CHECK(0);
+}
+
+static void deleteNew(void *data) {
+	deleteNewRan = 1;
+	taskSuspend(0);
+}
+
+// A deleted task is no longer scheduled and the next task created takes
+// its memory, a pool slot with TASK_POOL_TASKS, else the arena top.
+static void deleteTask(void *data) {
+	Task *victim;
+	uint16_t runs;
+
+	victim = taskCreatePrio(deleteVictim, 0, 1);
+	taskSleep(TICKS(5));
+	CHECK(deleteRuns > 0);
+
+	taskDelete(victim);
+	runs = deleteRuns;
+	CHECK(taskCreatePrio(deleteNew, 0, 1) == victim);
+	taskSleep(TICKS(10));
+	CHECK(deleteNewRan);
+	CHECK(deleteRuns == runs);
+
+	// The scheduler frees a task deleting itself. victim is the deleteNew
+	// task now, make room first.
+	taskDelete(victim);
+	victim = taskCreatePrio(deleteSelf, 0, 1);
+	taskSleep(TICKS(2));
+	CHECK(taskCreatePrio(deleteNew, 0, 1) == victim);
+	exit(0);
+}
+
+static void testDelete(void) {
+	taskCreatePrio(deleteTask, 0, 2);
+}
+
+static Timer timerOnce;
+
+static Timer timerPeriodic;
+
+static Timer timerStopped;
+
+static TASK_TICK_T timerOnceAt;
+
+static uint8_t timerOnceCount;
+
+static TASK_TICK_T timerPeriodicAt[5];
+
+static uint8_t timerPeriodicCount;
+
+static void timerOnceFn(void *data) {
+	timerOnceAt = taskTickCount();
+	timerOnceCount++;
+}
+
+static void timerPeriodicFn(void *data) {
+	timerPeriodicAt[timerPeriodicCount++] = taskTickCount();
+
+	if (timerPeriodicCount == 5) {
+		timerStop(&timerPeriodic);
+	}
+}
+
+static void timerStoppedFn(void *data) {
+	CHECK(0);
+}
+
+// A one-shot fires once, a periodic timer keeps its phase until stopped
+// from its own callback, a timer stopped before expiry never fires.
+static void timerTestTask(void *data) {
+	TASK_TICK_T start;
+	uint8_t i;
+
+	timerInit(&timerOnce, timerOnceFn, 0);
+	timerInit(&timerPeriodic, timerPeriodicFn, 0);
+	timerInit(&timerStopped, timerStoppedFn, 0);
+
+	start = taskTickCount();
+	timerStart(&timerOnce, TICKS(5), 0);
+	timerStart(&timerPeriodic, TICKS(3), TICKS(2));
+	timerStart(&timerStopped, TICKS(4), 0);
+	taskSleep(TICKS(2));
+	timerStop(&timerStopped);
+
+	taskSleep(TICKS(30));
+
+	CHECK(timerOnceCount == 1);
+	CHECK(timerOnceAt - start == 5);
+	CHECK(timerPeriodicCount == 5);
+	CHECK(timerPeriodicAt[0] - start == 3);
+	for (i = 1; i < 5; i++) {
+		CHECK(timerPeriodicAt[i] - timerPeriodicAt[i - 1] == 2);
+	}
+	exit(0);
+}
+
+static void testTimer(void) {
+	taskCreatePrio(timerDaemon, 0, 3);
+	taskCreatePrio(timerTestTask, 0, 2);
+}
+
+#if !TASK_SCHED_EDF
+static Mutex testMutex;
+
+static Task *testOwner;
+
+// The waiter times out while the owner holds the lock, the owner gets its
+// lent priority back.
+static void mutexTimeoutOwner(void *data) {
+	mutexLock(&testMutex);
+	taskSleep(TICKS(20));
+	mutexUnlock(&testMutex);
+	taskSuspend(0);
+}
+
+static void mutexTimeoutWaiter(void *data) {
+	taskSleep(TICKS(2));
+	CHECK(mutexLockTimeout(&testMutex, TICKS(5)) == MUTEX_TIMEOUT);
+	CHECK(testOwner->priority == 1);
+	CHECK(mutexLockTimeout(&testMutex, TICKS(50)) == MUTEX_OK);
+	CHECK(testOwner->priority == 1);
+	exit(0);
+}
+
+static void testMutexTimeout(void) {
+	mutexInit(&testMutex);
+	testOwner = taskCreatePrio(mutexTimeoutOwner, 0, 1);
+	taskCreatePrio(mutexTimeoutWaiter, 0, 2);
+}
+
+// The waiter times out, but the higher priority owner unlocks before the
+// waiter gets to run again.
+static void mutexUnlockOwner(void *data) {
+	mutexLock(&testMutex);
+	taskSleep(TICKS(2));
+	testSpin(10);
+	mutexUnlock(&testMutex);
+	taskSleep(TICKS(50));
+	CHECK(0);
+}
+
+static void mutexUnlockWaiter(void *data) {
+	CHECK(mutexLockTimeout(&testMutex, TICKS(5)) == MUTEX_TIMEOUT);
+	CHECK(testMutex.owner == 0);
+	CHECK(testOwner->priority == 2);
+	exit(0);
+}
+
+// Unlocking a mutex the caller does not hold leaves it as it is.
+static void mutexStranger(void *data) {
+	mutexUnlock(&testMutex);
+	taskSuspend(0);
+}
+
+static void mutexUnlockUnlockedTask(void *data) {
+	mutexUnlock(&testMutex);
+	CHECK(testMutex.status == MUTEX_UNLOCKED && testMutex.owner == 0);
+
+	mutexLock(&testMutex);
+	taskCreatePrio(mutexStranger, 0, 2);
+	CHECK(testMutex.owner == taskCurrent());
+	CHECK(taskCurrent()->mutexes == 1);
+	mutexUnlock(&testMutex);
+	CHECK(testMutex.status == MUTEX_UNLOCKED);
+	exit(0);
+}
+
+static void testMutexUnlockUnlocked(void) {
+	mutexInit(&testMutex);
+	taskCreatePrio(mutexUnlockUnlockedTask, 0, 1);
+}
+
+static void testMutexUnlockAfterTimeout(void) {
+	mutexInit(&testMutex);
+	testOwner = taskCreatePrio(mutexUnlockOwner, 0, 2);
+	taskCreatePrio(mutexUnlockWaiter, 0, 1);
+}
+
+// The owner runs at the priority of its highest waiter while they are
+// blocked. When that waiter times out the owner drops to the next one,
+// and back to its own priority once it unlocks.
+static void mutexInheritOwner(void *data) {
+	mutexLock(&testMutex);
+	taskSleep(TICKS(3));
+	CHECK(taskCurrent()->priority == 3);
+	CHECK(taskCurrent()->basePriority == 1);
+
+	// The priority 3 waiter times out meanwhile.
+	taskSleep(TICKS(10));
+	CHECK(taskCurrent()->priority == 2);
+	mutexUnlock(&testMutex);
+	CHECK(0);
+}
+
+static void mutexInheritTimed(void *data) {
+	taskSleep(TICKS(1));
+	CHECK(mutexLockTimeout(&testMutex, TICKS(5)) == MUTEX_TIMEOUT);
+	CHECK(testMutex.owner == testOwner);
+	CHECK(testOwner->priority == 2);
+	taskSuspend(0);
+}
+
+static void mutexInheritWaiter(void *data) {
+	taskSleep(TICKS(2));
+	mutexLock(&testMutex);
+	CHECK(testMutex.owner == taskCurrent());
+	CHECK(testOwner->priority == 1);
+	exit(0);
+}
+
+static void testMutexInherit(void) {
+	mutexInit(&testMutex);
+	testOwner = taskCreatePrio(mutexInheritOwner, 0, 1);
+	taskCreatePrio(mutexInheritWaiter, 0, 2);
+	taskCreatePrio(mutexInheritTimed, 0, 3);
+}
+#endif
+
+#if TASK_NOTIFY
+// The waiting task, notified by the other one.
+static Task *notifyTarget;
+#endif
+
+#if TASK_NOTIFY && !TASK_SCHED_EDF
+static uint16_t notifyValues[3];
+
+// Every action and the timed wait, the higher priority waiter runs as soon
+// as it is notified.
+static void notifyWaiter(void *data) {
+	notifyValues[0] = taskNotifyWait();
+	notifyValues[1] = taskNotifyWait();
+	CHECK(taskNotifyWaitTimeout(0, TICKS(5)) == TASK_NOTIFY_TIMEOUT);
+	CHECK(taskNotifyWaitTimeout(0, 0) == TASK_NOTIFY_TIMEOUT);
+	CHECK(taskNotifyWaitTimeout(&notifyValues[2], TICKS(50)) == TASK_NOTIFY_OK);
+	taskSuspend(0);
+}
+
+static void notifyTask(void *data) {
+	taskSleep(TICKS(2));
+	taskNotify(notifyTarget, 0x10, TASK_NOTIFY_BITS);
+	taskNotify(notifyTarget, 0, TASK_NOTIFY_INCREMENT);
+	taskSleep(TICKS(25));
+	taskNotify(notifyTarget, 77, TASK_NOTIFY_OVERWRITE);
+
+	CHECK(notifyValues[0] == 0x10);
+	CHECK(notifyValues[1] == 1);
+	CHECK(notifyValues[2] == 77);
+	exit(0);
+}
+
+static void testNotify(void) {
+	notifyTarget = taskCreatePrio(notifyWaiter, 0, 2);
+	taskCreatePrio(notifyTask, 0, 1);
+}
+#endif
+
+#if TASK_NOTIFY
+// Notifications sent before the wait add up.
+static void notifyCountWaiter(void *data) {
+	CHECK(taskNotifyWait() == 3);
+	exit(0);
+}
+
+static void notifyCountTask(void *data) {
+	taskNotify(notifyTarget, 0, TASK_NOTIFY_INCREMENT);
+	taskNotify(notifyTarget, 0, TASK_NOTIFY_INCREMENT);
+	taskNotify(notifyTarget, 0, TASK_NOTIFY_INCREMENT);
+	taskSuspend(0);
+}
+
+static void testNotifyCount(void) {
+	notifyTarget = taskCreatePrio(notifyCountWaiter, 0, 1);
+	taskCreatePrio(notifyCountTask, 0, 2);
+}
+#endif
+
+static RING_BUFFER(ringBuffer, 3, 8);
+
+static Ring testRing;
+
+// Elements of 3 bytes in a ring of 8, bulk copies across the end of the
+// buffer, and the last free slot.
+static void ringTask(void *data) {
+	uint8_t in[3 * 8];
+	uint8_t out[3 * 8];
+	uint8_t c;
+	uint8_t i;
+
+	CHECK(ringInit(&testRing, ringBuffer, 3, 6) == 0);
+	CHECK(ringInit(&testRing, ringBuffer, 3, 0) == 0);
+	CHECK(ringInit(&testRing, ringBuffer, 3, 8) == 1);
+
+	for (i = 0; i < sizeof(in); i++) {
+		in[i] = i;
+	}
+
+	// Move head and tail to element 5, the next 6 elements wrap.
+	CHECK(ringWrite(&testRing, in, 5) == 5);
+	CHECK(ringRead(&testRing, out, 5) == 5);
+	CHECK(ringWrite(&testRing, in, 6) == 6);
+	CHECK(ringCount(&testRing) == 6);
+	CHECK(ringRead(&testRing, out, 8) == 6);
+	for (i = 0; i < 3 * 6; i++) {
+		CHECK(out[i] == in[i]);
+	}
+
+	// Full at 8 elements, a bulk write stops there.
+	CHECK(ringWrite(&testRing, in, 7) == 7);
+	CHECK(ringSpace(&testRing) == 1);
+	CHECK(ringWrite(&testRing, in + 3 * 7, 3) == 1);
+	CHECK(ringSpace(&testRing) == 0);
+	CHECK(ringCount(&testRing) == 8);
+	CHECK(ringWrite(&testRing, in, 1) == 0);
+	CHECK(ringRead(&testRing, out, 8) == 8);
+	for (i = 0; i < sizeof(in); i++) {
+		CHECK(out[i] == in[i]);
+	}
+	CHECK(ringRead(&testRing, out, 1) == 0);
+
+	// The byte functions, full at count too.
+	CHECK(ringInit(&testRing, ringBuffer, 1, 4) == 1);
+	for (i = 0; i < 4; i++) {
+		CHECK(ringPut(&testRing, i) == 1);
+	}
+	CHECK(ringPut(&testRing, 4) == 0);
+	for (i = 0; i < 4; i++) {
+		CHECK(ringGet(&testRing, &c) == 1 && c == i);
+	}
+	CHECK(ringGet(&testRing, &c) == 0);
+	exit(0);
+}
+
+static void testRingBuffer(void) {
+	taskCreate(ringTask, 0);
+}
+
+#if TASK_NOTIFY
+// The consumer is notified once the threshold is queued, not before.
+static void ringConsumer(void *data) {
+	uint8_t out[8];
+
+	CHECK(taskNotifyWait() == 0x04);
+	CHECK(ringRead(&testRing, out, sizeof(out)) == 3);
+	taskSuspend(0);
+}
+
+static void ringProducer(void *data) {
+	uint8_t i;
+
+	for (i = 0; i < 2; i++) {
+		CHECK(ringPut(&testRing, i) == 1);
+		taskYield();
+		CHECK(notifyTarget->state == TASK_STATE_BLOCKED);
+	}
+
+	CHECK(ringPut(&testRing, i) == 1);
+	CHECK(notifyTarget->state == TASK_STATE_READY);
+	taskYield();
+	CHECK(ringCount(&testRing) == 0);
+	exit(0);
+}
+
+static void testRingNotify(void) {
+	ringInit(&testRing, ringBuffer, 1, 8);
+	notifyTarget = taskCreatePrio(ringConsumer, 0, 2);
+	ringNotify(&testRing, notifyTarget, 3, 0x04);
+	taskCreatePrio(ringProducer, 0, 1);
+}
+#endif
+
+#if TASK_COROUTINES
+typedef struct {
+	uint8_t n;
+	uint8_t sleeps;
+	uint8_t takes;
+} CoState;
+
+static CoState coState;
+
+static uint8_t coOrder[4];
+
+static uint8_t coSteps;
+
+static void coBody(Task *t, void *data) {
+	CoState *s = data;
+
+	CO_BEGIN(t);
+	for (s->n = 0; s->n < 10; s->n++) {
+		CO_SLEEP(t, TICKS(1));
+		s->sleeps++;
+	}
+
+	CO_WAIT(t, semaphoreTake(&testSemaphore));
+	s->takes++;
+
+	// Waking the higher priority task does not cut the coroutine off.
+	coOrder[coSteps++] = 1;
+	semaphoreGive(&testSemaphore);
+	coOrder[coSteps++] = 2;
+	CO_END(t);
+}
+
+static void coHigh(void *data) {
+	taskSleep(TICKS(30));
+	semaphoreGive(&testSemaphore);
+	semaphoreTake(&testSemaphore);
+	coOrder[coSteps++] = 3;
+
+	CHECK(coState.sleeps == 10);
+	CHECK(coState.takes == 1);
+	CHECK(coSteps == 3);
+	CHECK(coOrder[0] == 1 && coOrder[1] == 2 && coOrder[2] == 3);
+	exit(0);
+}
+
+static void testCoroutine(void) {
+	semaphoreInit(&testSemaphore, 0);
+	taskCreateCoroutine(coBody, &coState, 1);
+	taskCreatePrio(coHigh, 0, 2);
+}
+#endif
+
+#if TASK_TRACE
+// Tick count rebuilt from the records read so far, as tools/tracedecode.c
+// does.
+static uint32_t traceTestHigh;
+
+static uint32_t traceTestTick;
+
+static uint8_t traceTestSyncs;
+
+static uint8_t traceTestLost;
+
+static void traceTestRead(void) {
+	TraceRecord r;
+
+	while (traceRead(&r)) {
+		if (r.event == TRACE_SYNC) {
+			traceTestHigh = (uint32_t)r.task << 16 | r.time;
+			traceTestSyncs++;
+		} else if (r.event != TRACE_INFO) {
+			traceTestTick = traceTestHigh << 8 | r.time >> 8;
+
+			if (r.event == TRACE_LOST) {
+				traceTestLost++;
+			}
+		}
+	}
+}
+
+// Absolute ticks survive a gap of more than 255 ticks between records and
+// a full buffer dropping records.
+static void traceTask(void *data) {
+	uint8_t syncs;
+	uint16_t i;
+
+	traceTestRead();
+
+	syncs = traceTestSyncs;
+	taskSleep(TICKS(300));
+	traceTestRead();
+	CHECK(traceTestSyncs > syncs);
+	CHECK(taskTickCount() - traceTestTick <= 1);
+
+	// Every yield logs a switch, more than the buffer holds.
+	syncs = traceTestSyncs;
+	for (i = 0; i < TASK_TRACE_SIZE; i++) {
+		taskYield();
+	}
+	CHECK(traceLost != 0);
+	traceTestRead();
+	CHECK(traceTestLost == 1);
+	CHECK(traceTestSyncs > syncs);
+	CHECK(taskTickCount() - traceTestTick <= 1);
+	exit(0);
+}
+
+static void testTrace(void) {
+	taskCreate(traceTask, 0);
+}
+#endif
+
+#if TASK_SCHED_EDF
+// Tasks are admitted while the utilization stays at or below 1, deleting
+// one gives its share back.
+static void edfTask(void *data) {
+	for (;;) {
+		taskSleep(TICKS(500));
+	}
+}
+
+static void edfAdmitTask(void *data) {
+	Task *a;
+	Task *b;
+	Task *c;
+
+	a = taskCreateDeadline(edfTask, 0, TASK_STACK_MIN, 5, 10, 0);
+	b = taskCreateDeadline(edfTask, 0, TASK_STACK_MIN, 6, 14, 0);
+	CHECK(a && b);
+	CHECK(taskCreateDeadline(edfTask, 0, TASK_STACK_MIN, 1, 10, 0) == 0);
+
+	taskDelete(b);
+	b = taskCreateDeadline(edfTask, 0, TASK_STACK_MIN, 1, 10, 0);
+	c = taskCreateDeadline(edfTask, 0, TASK_STACK_MIN, 4, 10, 0);
+	CHECK(b && c);
+	CHECK(taskCreateDeadline(edfTask, 0, TASK_STACK_MIN, 1, 10, 0) == 0);
+
+	// Loaded to exactly 1, a huge share must not wrap the sum back into
+	// range.
+	taskDelete(c);
+	taskDelete(b);
+	CHECK(taskCreateDeadline(edfTask, 0, TASK_STACK_MIN, 1, 2, 0) != 0);
+	CHECK(taskCreateDeadline(edfTask, 0, TASK_STACK_MIN, 65535, 1, 0) == 0);
+	exit(0);
+}
+
+static void testEdfAdmission(void) {
+	taskCreate(edfAdmitTask, 0);
+}
+
+static char edfOrder[8];
+
+static uint8_t edfRuns;
+
+// Each job starts with its deadline relDeadline after the release.
+static void edfOrderTask(void *data) {
+	TASK_TICK_T last = 0;
+	Task *t = taskCurrent();
+
+	for (;;) {
+		CHECK(t->deadline == t->baseDeadline);
+		CHECK(t->baseDeadline == (TASK_TICK_T)(last + t->relDeadline));
+		edfOrder[edfRuns++] = *(char *)data;
+
+		if (edfRuns == 5) {
+			// b is released every 10 ticks due 8 ticks later, a every 20
+			// due 20 later, at the same time as every other b.
+			CHECK(memcmp(edfOrder, "babba", 5) == 0);
+			exit(0);
+		}
+
+		taskDelayUntil(&last, t->relDeadline == 8 ? 10 : 20);
+	}
+}
+
+static void testEdfOrder(void) {
+	edfRuns = 0;
+	taskCreateDeadline(edfOrderTask, "a", TASK_STACK_DEFAULT, 2, 20, 0);
+	taskCreateDeadline(edfOrderTask, "b", TASK_STACK_DEFAULT, 2, 10, 8);
+}
+
+static Mutex edfMutex;
+
+static Task *edfOwner;
+
+static Task *edfWaiter;
+
+// The owner runs with the deadline of the waiter blocked on its mutex, and
+// gets its own back when it unlocks.
+static void edfInheritOwner(void *data) {
+	mutexLock(&edfMutex);
+
+	while (edfWaiter->state != TASK_STATE_BLOCKED) {
+	}
+
+	CHECK(edfOwner->deadline == edfWaiter->deadline);
+	CHECK(edfOwner->baseDeadline == 100);
+	mutexUnlock(&edfMutex);
+	CHECK(0);
+}
+
+static void edfInheritWaiter(void *data) {
+	taskSleep(TICKS(2));
+	CHECK(edfWaiter->deadline == taskTickCount() + 10);
+	mutexLock(&edfMutex);
+	CHECK(edfMutex.owner == edfWaiter);
+	CHECK(edfOwner->deadline == 100);
+	exit(0);
+}
+
+static void testEdfInherit(void) {
+	mutexInit(&edfMutex);
+	edfOwner = taskCreateDeadline(edfInheritOwner, 0, TASK_STACK_DEFAULT, 1, 100, 0);
+	edfWaiter = taskCreateDeadline(edfInheritWaiter, 0, TASK_STACK_DEFAULT, 1, 10, 0);
+}
+#endif
+
+static const Test tests[] = {
+	{"sleep", testSleep},
+	{"sleep_round", testSleepRound},
+	{"delay_until", testDelayUntil},
+	{"advance_late", testAdvanceLate},
+	{"create_preempt", testCreatePreempt},
+	#if !TASK_SCHED_EDF
+	{"quantum", testQuantum},
+	#endif
+	{"semaphore_timeout", testSemaphoreTimeout},
+	{"message_timeout", testMessageTimeout},
+	{"message_large", testMessageLarge},
+	#if !TASK_SCHED_EDF
+	{"message_handoff", testMessageHandoff},
+	{"message_isr", testMessageIsr},
+	{"message_rendezvous", testMessageRendezvous},
+	#endif
+	{"event", testEvent},
+	{"timer", testTimer},
+	{"scheduler_stack", testSchedulerStack},
+	{"pool", testPoolBlocks},
+	{"delete", testDelete},
+	#if !TASK_SCHED_EDF
+	{"mutex_inherit", testMutexInherit},
+	{"mutex_timeout", testMutexTimeout},
+	{"mutex_unlock_after_timeout", testMutexUnlockAfterTimeout},
+	{"mutex_unlock_unlocked", testMutexUnlockUnlocked},
+	#endif
+	#if TASK_NOTIFY && !TASK_SCHED_EDF
+	{"notify", testNotify},
+	#endif
+	#if TASK_NOTIFY
+	{"notify_count", testNotifyCount},
+	#endif
+	{"ring", testRingBuffer},
+	#if TASK_NOTIFY
+	{"ring_notify", testRingNotify},
+	#endif
+	#if TASK_COROUTINES
+	{"coroutine", testCoroutine},
+	#endif
+	#if TASK_TRACE
+	{"trace", testTrace},
+	#endif
+	#if TASK_SCHED_EDF
+	{"edf_admission", testEdfAdmission},
+	{"edf_order", testEdfOrder},
+	{"edf_inherit", testEdfInherit},
+	#endif
+};
+
+// Returns 1 when the test passed.
+static uint8_t testRun(const Test *test) {
+	pid_t pid;
+	int status;
+	int waited;
+
+	fflush(stdout);
+
+	pid = fork();
+	if (pid == 0) {
+		taskInit();
+		test->setup();
+		taskStart();
+		exit(1);
+	}
+
+	for (waited = 0; waited < TEST_TIMEOUT; waited += 10) {
+		if (waitpid(pid, &status, WNOHANG) == pid) {
+			return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+		}
+
+		usleep(10000);
+	}
+
+	kill(pid, SIGKILL);
+	waitpid(pid, &status, 0);
+	printf("  timed out\n");
+
+	return 0;
+}
+
+int main(void) {
+	uint8_t failed = 0;
+	uint8_t i;
+
+	for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		if (testRun(&tests[i])) {
+			printf("pass %s\n", tests[i].name);
+		} else {
+			printf("FAIL %s\n", tests[i].name);
+			failed++;
+		}
+	}
+
+	return failed != 0;
+}
@@ -0,0 +1,265 @@
+/*
+ * timer.c
+ *
+ * Created: 10/16/2026 5:20:13 PM
+ *  Author: Alex Ionita
+ */ 
+
+#include "timer.h"
+
+#include "port.h"
+
+#ifdef __AVR__
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#endif
+
+#if TASK_TIMER
+
+// A fast timer this many TIMER0 counts from expiry is due already, there
+// is not enough time left to arm the compare for it.
+#ifndef TIMER_FAST_MIN
+#define TIMER_FAST_MIN 2
+#endif
+
+// Started timers, by expiry. Initialized empty, the head points to itself.
+static QUEUE timerList = {&timerList, &timerList};
+
+// Started timerStartUs() timers, by expiry.
+static QUEUE timerFast = {&timerFast, &timerFast};
+
+// Fast timers that expired, waiting for the daemon to call them.
+static QUEUE timerDue = {&timerDue, &timerDue};
+
+// The daemon waits here while no timer is due.
+static QUEUE timerWait = {&timerWait, &timerWait};
+
+static Task *timerTask;
+
+// Insert t into h, behind the timers expiring at the same time or earlier.
+// Compared wrap-safe, a timer that is overdue already still sorts first.
+static void timerInsert(QUEUE *h, Timer *t) {
+	QUEUE *q;
+
+	QUEUE_FOREACH(q, h) {
+		Timer *other = QUEUE_DATA(q, Timer, member);
+
+		if (t->fast) {
+			if ((int32_t)(t->expiry - other->expiry) < 0) {
+				break;
+			}
+		} else if ((TASK_TICK_T)(t->expiry - other->expiry) > TASK_TICK_HALF) {
+			break;
+		}
+	}
+
+	QUEUE_INSERT_TAIL(q, &t->member);
+}
+
+// Wake the daemon if it waits, so it looks at a new earliest timer.
+static void timerKick(uint8_t fromISR) {
+	if (timerTask && !QUEUE_EMPTY(&timerWait)) {
+		if (fromISR) {
+			taskWakeupFromISR(timerTask);
+		} else {
+			taskWakeup(timerTask);
+		}
+	}
+}
+
+#ifdef __AVR__
+// TIMER0 counts since taskInit().
+static uint32_t timerNow(void) {
+	uint8_t count = portTimerCount();
+	uint32_t now = (uint32_t)taskTickCount() * COUNTS_PER_TICK;
+
+	// The counter wrapped, but the tick interrupt has not run yet.
+	if (portTimerPending() && count < COUNTS_PER_TICK / 2) {
+		now += COUNTS_PER_TICK;
+	}
+
+	return now + count;
+}
+
+// Point the OCR0B compare at the earliest fast timer. The compare matches
+// once per tick, the ISR checks whether it is the right tick.
+static void timerArm(void) {
+	if (QUEUE_EMPTY(&timerFast)) {
+		TIMSK0 &= ~_BV(OCIE0B);
+		return;
+	}
+
+	OCR0B = QUEUE_DATA(QUEUE_HEAD(&timerFast), Timer, member)->expiry % COUNTS_PER_TICK;
+	TIFR0 = _BV(OCF0B);
+	TIMSK0 |= _BV(OCIE0B);
+}
+
+// Move the fast timers that are due to timerDue and re-arm. Returns 1 when
+// it moved any.
+static uint8_t timerFastCheck(void) {
+	uint32_t now = timerNow();
+	uint8_t moved = 0;
+
+	while (!QUEUE_EMPTY(&timerFast)) {
+		Timer *t = QUEUE_DATA(QUEUE_HEAD(&timerFast), Timer, member);
+
+		if ((int32_t)(t->expiry - now) > TIMER_FAST_MIN) {
+			break;
+		}
+
+		QUEUE_REMOVE(&t->member);
+		QUEUE_INSERT_TAIL(&timerDue, &t->member);
+		moved = 1;
+	}
+
+	timerArm();
+
+	return moved;
+}
+
+TASK_ISR(TIMER0_COMPB_vect) {
+	if (timerFastCheck()) {
+		timerKick(1);
+		taskPreempt();
+	}
+}
+#endif
+
+static void timerUnlink(Timer *t) {
+	QUEUE_REMOVE(&t->member);
+	QUEUE_INIT(&t->member);
+
+	#ifdef __AVR__
+	if (t->fast) {
+		timerArm();
+	}
+	#endif
+}
+
+static void timerStartTicks(Timer *t, uint16_t ticks, uint16_t period) {
+	PortIrqState irq;
+
+	irq = portIrqSave();
+
+	timerUnlink(t);
+
+	t->fast = 0;
+	t->period = period;
+	t->expiry = (TASK_TICK_T)(taskTickCount() + ticks);
+	timerInsert(&timerList, t);
+
+	if (QUEUE_HEAD(&timerList) == &t->member) {
+		timerKick(0);
+	}
+
+	portIrqRestore(irq);
+}
+
+void timerInit(Timer *t, TimerFunction fn, void *data) {
+	QUEUE_INIT(&t->member);
+	t->fn = fn;
+	t->data = data;
+	t->fast = 0;
+}
+
+void timerStart(Timer *t, uint16_t ms, uint16_t periodMs) {
+	timerStartTicks(t, taskMsToTicks(ms), periodMs ? taskMsToTicks(periodMs) : 0);
+}
+
+void timerStartUs(Timer *t, uint16_t us) {
+	#ifdef __AVR__
+	PortIrqState irq;
+	uint32_t counts = (uint32_t)us * COUNTS_PER_TICK / US_PER_TICK;
+
+	irq = portIrqSave();
+
+	timerUnlink(t);
+
+	t->fast = 1;
+	t->period = 0;
+	t->expiry = timerNow() + counts;
+	timerInsert(&timerFast, t);
+
+	if (timerFastCheck()) {
+		timerKick(0);
+	}
+
+	portIrqRestore(irq);
+	#else
+	timerStartTicks(t, (us + US_PER_TICK - 1) / US_PER_TICK, 0);
+	#endif
+}
+
+void timerStop(Timer *t) {
+	PortIrqState irq;
+
+	irq = portIrqSave();
+	timerUnlink(t);
+	portIrqRestore(irq);
+}
+
+// Take the next timer to call off its list, or set *ticks to how long the
+// earliest one has to go, 0 when there is none.
+static Timer *timerNext(uint16_t *ticks) {
+	Timer *t;
+	TASK_TICK_T now;
+	TASK_TICK_T left;
+
+	*ticks = 0;
+
+	if (!QUEUE_EMPTY(&timerDue)) {
+		t = QUEUE_DATA(QUEUE_HEAD(&timerDue), Timer, member);
+		timerUnlink(t);
+		return t;
+	}
+
+	if (QUEUE_EMPTY(&timerList)) {
+		return 0;
+	}
+
+	now = taskTickCount();
+	t = QUEUE_DATA(QUEUE_HEAD(&timerList), Timer, member);
+	left = t->expiry - now;
+
+	// Past expiries wrap around to the upper half.
+	if (left && left <= TASK_TICK_HALF) {
+		*ticks = left < 0xFFFF / MS_PER_TICK ? left : 0xFFFF / MS_PER_TICK;
+		return 0;
+	}
+
+	timerUnlink(t);
+
+	// Periodic timers keep their phase, a late call does not shift the next.
+	if (t->period) {
+		t->expiry = (TASK_TICK_T)(t->expiry + t->period);
+		timerInsert(&timerList, t);
+	}
+
+	return t;
+}
+
+void timerDaemon(void *data) {
+	PortIrqState irq;
+	Timer *t;
+	uint16_t ticks;
+
+	irq = portIrqSave();
+
+	timerTask = taskCurrent();
+
+	for (;;) {
+		t = timerNext(&ticks);
+
+		if (t) {
+			portIrqRestore(irq);
+			t->fn(t->data);
+			irq = portIrqSave();
+		} else if (ticks) {
+			taskSuspendTimeout(&timerWait, ticks * MS_PER_TICK);
+		} else {
+			taskSuspend(&timerWait);
+		}
+	}
+}
+
+#endif // TASK_TIMER
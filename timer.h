@@ -0,0 +1,51 @@
+/*
+ * timer.h
+ *
+ * Created: 10/16/2026 5:12:40 PM
+ *  Author: Alex Ionita
+ */ 
+
+
+#ifndef TIMER_H_
+#define TIMER_H_
+
+#include <stdint.h>
+
+#include "task.h"
+
+// Software timers. Callbacks run in timerDaemon(), a task the application
+// creates at a priority above the tasks they serve, so they may block and
+// use the whole kernel API. They should still be short, a callback delays
+// every timer due after it.
+
+typedef void (*TimerFunction)(void *);
+
+typedef struct Timer {
+	QUEUE member;
+	TimerFunction fn;
+	void *data;
+	uint32_t expiry; // Tick, or TIMER0 count for timerStartUs().
+	uint16_t period; // Ticks, 0 for a one-shot.
+	uint8_t fast;
+} Timer;
+
+void timerInit(Timer *t, TimerFunction fn, void *data);
+
+// Call fn after ms milliseconds, then every periodMs milliseconds unless
+// that is 0. Both are rounded up to whole ticks, at least one, like
+// taskMsToTicks().
+// Restarts a timer that is running already.
+void timerStart(Timer *t, uint16_t ms, uint16_t periodMs);
+
+// One-shot after us microseconds, at TIMER0 count resolution (US_PER_COUNT)
+// through the OCR0B compare. Needs a 32-bit TASK_TICK_T. On the host it
+// rounds up to whole ticks.
+void timerStartUs(Timer *t, uint16_t us);
+
+// Callable from a callback, also for its own timer.
+void timerStop(Timer *t);
+
+// The timer task, create it once: taskCreatePrio(timerDaemon, 0, prio).
+void timerDaemon(void *data);
+
+#endif /* TIMER_H_ */
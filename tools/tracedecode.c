@@ -0,0 +1,156 @@
+/*
+ * tracedecode.c
+ *
+ * Created: 10/16/2026 3:41:20 PM
+ *  Author: Alex Ionita
+ *
+ * Turns the records sent by traceDrain() into a Chrome trace, to be opened
+ * in chrome://tracing or ui.perfetto.dev. Runs on the host:
+ *
+ *   cc -o tracedecode tracedecode.c
+ *   ./tracedecode dump.bin > trace.json
+ *
+ * The dump has to start with the TRACE_INFO record the firmware sends
+ * first after reset. Tasks show as threads named after their id, with a
+ * slice for each time they run, idle time shows as thread 0.
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+// Keep in sync with trace.h.
+#define TRACE_INFO 0
+#define TRACE_SWITCH 1
+#define TRACE_IDLE 2
+#define TRACE_TICK 3
+#define TRACE_WAKEUP 4
+#define TRACE_SUSPEND 5
+#define TRACE_SLEEP 6
+#define TRACE_MUTEX_LOCK 7
+#define TRACE_MUTEX_WAIT 8
+#define TRACE_MUTEX_UNLOCK 9
+#define TRACE_LOST 10
+#define TRACE_SYNC 11
+
+// Thread of the running slice, -1 for none.
+static int running = -1;
+
+static uint8_t named[256];
+
+static int first = 1;
+
+// ph holds the phase and whatever else the event needs.
+static void traceEvent(double ts, int tid, const char *name, const char *ph) {
+	printf("%s\n{\"pid\":1,\"tid\":%d,\"ts\":%.1f,\"name\":\"%s\",%s}", first ? "" : ",", tid, ts, name, ph);
+	first = 0;
+}
+
+static void traceName(int tid) {
+	if (named[tid]) {
+		return;
+	}
+
+	named[tid] = 1;
+	printf("%s\n{\"pid\":1,\"tid\":%d,\"ph\":\"M\",\"name\":\"thread_name\",\"args\":{\"name\":", first ? "" : ",", tid);
+	if (tid) {
+		printf("\"task %d\"}}", tid);
+	} else {
+		printf("\"idle\"}}");
+	}
+	first = 0;
+}
+
+// End the running slice and start one on tid.
+static void traceRun(double ts, int tid) {
+	if (running == tid) {
+		return;
+	}
+
+	if (running >= 0) {
+		traceEvent(ts, running, running ? "run" : "idle", "\"ph\":\"E\"");
+	}
+
+	traceName(tid);
+	traceEvent(ts, tid, tid ? "run" : "idle", "\"ph\":\"B\"");
+	running = tid;
+}
+
+static void traceInstant(double ts, int tid, const char *name) {
+	traceName(tid);
+	traceEvent(ts, tid, name, "\"ph\":\"i\",\"s\":\"t\"");
+}
+
+int main(int argc, char **argv) {
+	static const char *names[] = {
+		"info", "switch", "idle", "tick", "wakeup", "suspend", "sleep",
+		"mutex lock", "mutex wait", "mutex unlock", "lost"
+	};
+	FILE *in = stdin;
+	uint8_t r[4];
+	uint32_t ticks = 0;
+	uint32_t high = 0;
+	double usPerTick = 2000;
+	double countsPerTick = 125;
+	double ts = 0;
+	char lost[16];
+
+	if (argc > 1) {
+		in = fopen(argv[1], "rb");
+		if (!in) {
+			perror(argv[1]);
+			return 1;
+		}
+	}
+
+	printf("{\"traceEvents\":[");
+
+	while (fread(r, sizeof(r), 1, in) == 1) {
+		uint8_t event = r[0];
+		uint8_t task = r[1];
+		uint16_t time = r[2] | r[3] << 8;
+
+		if (event == TRACE_INFO) {
+			countsPerTick = task;
+			usPerTick = time;
+			high = 0;
+			continue;
+		}
+
+		// The rest of the tick count, for the records that follow.
+		if (event == TRACE_SYNC) {
+			high = (uint32_t)task << 16 | time;
+			continue;
+		}
+
+		ticks = high << 8 | time >> 8;
+		ts = ticks * usPerTick + (time & 0xFF) * usPerTick / countsPerTick;
+
+		switch (event) {
+		case TRACE_SWITCH:
+			traceRun(ts, task);
+			break;
+
+		case TRACE_IDLE:
+			traceRun(ts, 0);
+			break;
+
+		case TRACE_LOST:
+			snprintf(lost, sizeof(lost), "lost %d", task);
+			traceEvent(ts, 0, lost, "\"ph\":\"i\",\"s\":\"g\"");
+			break;
+
+		default:
+			if (event < sizeof(names) / sizeof(names[0])) {
+				traceInstant(ts, task, names[event]);
+			}
+			break;
+		}
+	}
+
+	if (running >= 0) {
+		traceEvent(ts, running, running ? "run" : "idle", "\"ph\":\"E\"");
+	}
+
+	printf("\n]}\n");
+
+	return 0;
+}
@@ -0,0 +1,130 @@
+/*
+ * trace.c
+ *
+ * Created: 10/16/2026 3:10:58 PM
+ *  Author: Alex Ionita
+ */ 
+#include "trace.h"
+
+#if TASK_TRACE
+
+#ifndef __AVR__
+#include <stdio.h>
+#endif
+
+// Baud rate of the USART0 the records are sent on.
+#ifndef TASK_TRACE_BAUD
+#define TASK_TRACE_BAUD 115200
+#endif
+
+// How long traceDrain() sleeps once the buffer is empty.
+#ifndef TASK_TRACE_DRAIN_MS
+#define TASK_TRACE_DRAIN_MS 20
+#endif
+
+TraceRecord traceBuffer[TASK_TRACE_SIZE];
+
+// Written by traceRecord() only, the next record goes here.
+volatile uint8_t traceHead;
+
+// Written by traceRead() only, the oldest record sits here.
+volatile uint8_t traceTail;
+
+// Records dropped since the last TRACE_LOST was logged.
+uint8_t traceLost;
+
+// Tick count, kept by taskAdvance().
+TASK_TICK_T traceTicks;
+
+// Tick count bits 8 and up of the last record, as the decoder knows them.
+TASK_TICK_T traceHigh;
+
+void traceInit(void) {
+	PortIrqState irq = portIrqSave();
+
+	// Time scale for the decoder.
+	traceBuffer[0].event = TRACE_INFO;
+	traceBuffer[0].task = COUNTS_PER_TICK;
+	traceBuffer[0].time = US_PER_TICK;
+
+	traceHead = 1;
+	traceTail = 0;
+	traceLost = 0;
+	traceTicks = 0;
+
+	// The decoder starts from tick 0 at TRACE_INFO.
+	traceHigh = 0;
+
+	portIrqRestore(irq);
+
+	#ifdef __AVR__
+	UCSR0A = _BV(U2X0);
+	UBRR0 = F_CPU / 8 / TASK_TRACE_BAUD - 1;
+	UCSR0B = _BV(TXEN0);
+	UCSR0C = _BV(UCSZ01) | _BV(UCSZ00);
+	#endif
+}
+
+uint8_t traceRead(TraceRecord *r) {
+	PortIrqState irq = portIrqSave();
+	uint8_t tail = traceTail;
+	uint8_t lost = traceLost;
+
+	if (tail == traceHead) {
+		portIrqRestore(irq);
+		return 0;
+	}
+
+	*r = traceBuffer[tail];
+	traceTail = (tail + 1) & (TASK_TRACE_SIZE - 1);
+
+	// Records are only dropped while the buffer is full, log the gap now
+	// that there is room.
+	if (lost) {
+		traceLost = 0;
+		traceRecord(TRACE_LOST, lost);
+
+		// No room yet for it and its TRACE_SYNC, try on the next read.
+		if (traceLost) {
+			traceLost = lost;
+		}
+	}
+
+	portIrqRestore(irq);
+
+	return 1;
+}
+
+static void traceWrite(const TraceRecord *r) {
+	#ifdef __AVR__
+	const uint8_t *p = (const uint8_t *)r;
+	uint8_t i;
+
+	for (i = 0; i < sizeof(TraceRecord); i++) {
+		while (!(UCSR0A & _BV(UDRE0))) {
+		}
+
+		UDR0 = p[i];
+	}
+	#else
+	fwrite(r, sizeof(TraceRecord), 1, stdout);
+	#endif
+}
+
+void traceDrain(void *data) {
+	TraceRecord r;
+
+	for (;;) {
+		while (traceRead(&r)) {
+			traceWrite(&r);
+		}
+
+		#ifndef __AVR__
+		fflush(stdout);
+		#endif
+
+		taskSleep(TASK_TRACE_DRAIN_MS);
+	}
+}
+
+#endif // TASK_TRACE
@@ -0,0 +1,112 @@
+/*
+ * trace.h
+ *
+ * Created: 10/16/2026 3:02:37 PM
+ *  Author: Alex Ionita
+ */ 
+
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+
+#include "task.h"
+
+// Scheduler trace. With TASK_TRACE=1 the kernel logs its events into a RAM
+// ring buffer, traceDrain() sends them out as 4 byte records and
+// tools/tracedecode.c turns those into a Chrome trace.
+
+#define TRACE_INFO 0 // First record: task is COUNTS_PER_TICK, time US_PER_TICK.
+#define TRACE_SWITCH 1 // Scheduler resumes task.
+#define TRACE_IDLE 2 // Scheduler found nothing to run.
+#define TRACE_TICK 3 // Tick, task is the one interrupted.
+#define TRACE_WAKEUP 4 // Task made ready.
+#define TRACE_SUSPEND 5 // Task blocked on a wait queue.
+#define TRACE_SLEEP 6 // Task went to sleep.
+#define TRACE_MUTEX_LOCK 7 // Task took a mutex, or was handed it.
+#define TRACE_MUTEX_WAIT 8 // Task found the mutex locked.
+#define TRACE_MUTEX_UNLOCK 9
+#define TRACE_LOST 10 // task is the number of records dropped, saturating.
+#define TRACE_SYNC 11 // task and time are bits 24-31 and 8-23 of the tick count.
+
+// Records in the ring buffer, a power of two up to 256.
+#ifndef TASK_TRACE_SIZE
+#define TASK_TRACE_SIZE 64
+#endif
+
+#if TASK_TRACE_SIZE & (TASK_TRACE_SIZE - 1) || TASK_TRACE_SIZE > 256
+#error "TASK_TRACE_SIZE must be a power of two up to 256"
+#endif
+
+// Records carry only the low byte of the tick count. A TRACE_SYNC record
+// with the rest of it comes first whenever that changed since the last
+// record logged, or records were dropped.
+typedef struct {
+	uint8_t event; // TRACE_*
+	uint8_t task; // Task id, 0 for none.
+	uint16_t time; // Tick count low byte in the high byte, timer count in the low one.
+} TraceRecord;
+
+// traceHigh value that no tick count matches, forcing a TRACE_SYNC.
+#define TRACE_HIGH_NONE ((TASK_TICK_T)~(TASK_TICK_T)0)
+
+#if TASK_TRACE
+extern TraceRecord traceBuffer[TASK_TRACE_SIZE];
+extern volatile uint8_t traceHead;
+extern volatile uint8_t traceTail;
+extern uint8_t traceLost;
+extern TASK_TICK_T traceTicks;
+extern TASK_TICK_T traceHigh;
+
+// Log an event. Interrupts must be disabled.
+static inline void traceRecord(uint8_t event, uint8_t task) {
+	uint8_t head = traceHead;
+	uint8_t room = (traceTail - head - 1) & (TASK_TRACE_SIZE - 1);
+	TASK_TICK_T high = traceTicks >> 8;
+	uint8_t sync = high != traceHigh;
+	TraceRecord *r;
+
+	// The record goes in together with its TRACE_SYNC or not at all.
+	if (room <= sync) {
+		if (traceLost != 0xFF) {
+			traceLost++;
+		}
+		traceHigh = TRACE_HIGH_NONE;
+		return;
+	}
+
+	if (sync) {
+		r = &traceBuffer[head];
+		r->event = TRACE_SYNC;
+		r->task = (uint32_t)high >> 16;
+		r->time = high;
+		traceHigh = high;
+		head = (head + 1) & (TASK_TRACE_SIZE - 1);
+	}
+
+	r = &traceBuffer[head];
+	r->event = event;
+	r->task = task;
+	r->time = (uint16_t)(uint8_t)traceTicks << 8 | portTimerCount();
+	traceHead = (head + 1) & (TASK_TRACE_SIZE - 1);
+}
+
+#define TRACE(event, task) traceRecord(event, task)
+#define TRACE_TASK(event, t) traceRecord(event, (t) ? (t)->id : 0)
+#else
+#define TRACE(event, task)
+#define TRACE_TASK(event, t)
+#endif
+
+// Reset the buffer and log TRACE_INFO. Called by taskInit().
+void traceInit(void);
+
+// Take the oldest record off the buffer, returns 0 when it is empty.
+uint8_t traceRead(TraceRecord *r);
+
+// Task sending the records out, USART0 on the AVR, stdout on the host.
+// Create it with the lowest priority, data is unused.
+void traceDrain(void *data);
+
+#endif /* TRACE_H_ */